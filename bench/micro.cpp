@@ -0,0 +1,157 @@
+/* Microbenchmarks of single components with synthetic traffic. */
+#include "../src/cpu.h"
+
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <random>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace dark {
+
+/* Read the host cycle counter. Fall back to nanoseconds if absent. */
+inline uint64_t host_cycles() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+volatile uint64_t sink; /* Keep results alive from optimization. */
+
+/**
+ * @brief Run __func for __n operations and print ns/op and cycles/op.
+ *
+ * @param __func Callable taking the operation index.
+ */
+template <class F>
+void measure(const char *__name,size_t __n,F &&__func) {
+    for(size_t i = 0 ; i != __n / 16 ; ++i) __func(i); /* Warm up. */
+    auto     __beg = std::chrono::steady_clock::now();
+    uint64_t __cyc = host_cycles();
+    for(size_t i = 0 ; i != __n ; ++i) __func(i);
+    __cyc = host_cycles() - __cyc;
+    auto     __end = std::chrono::steady_clock::now();
+    double   __ns  = std::chrono::duration <double,std::nano> (__end - __beg).count();
+    std::cout << "| " << __name
+              << " | " << __n
+              << " | " << std::fixed << std::setprecision(2) << __ns / __n
+              << " | " << std::fixed << std::setprecision(2) << double(__cyc) / __n
+              << " |\n";
+}
+
+/* Random physical tag with a given chance of being ready. */
+uint32_t random_index(std::mt19937 &__gen,int __free_percent) {
+    if(int(__gen() % 100) < __free_percent) return PHYS_FREE;
+    return __gen() % PHYS_FREE;
+}
+
+/* Queue kept around 3/4 full, pushing and popping at random. */
+void bench_round_queue(size_t __n) {
+    round_queue <uint32_t,32> __q;
+    std::mt19937 __gen(1);
+    std::vector <uint8_t> __coin(4096);
+    for(auto &__c : __coin) __c = __gen() & 1;
+    measure("round_queue push/pop",__n,[&](size_t i) {
+        if(__q.full() || (__q.size() > 24 && __coin[i & 4095])) {
+            sink += __q.front();
+            __q.pop();
+        } else __q.push(i);
+    });
+}
+
+/* Loop-like branches: few hot PCs, mostly taken, a few in flight. */
+void bench_predictor(size_t __n) {
+    auto __p = std::make_unique <predictor> ();
+    std::mt19937 __gen(2);
+    struct branch { address_type pc; bool guess; bool real; };
+    std::vector <branch> __trace(4096);
+    for(auto &__b : __trace) {
+        __b.pc   = (__gen() % 64) << 2;
+        __b.real = __gen() % 8 != 0;
+    }
+    round_queue <branch,32> __flight; /* Predicted but not commited. */
+    measure("predictor predict/update",__n,[&](size_t i) {
+        auto __b  = __trace[i & 4095];
+        __b.guess = __p->predict(__b.pc);
+        __flight.push(__b);
+        if(__flight.size() > 4) {
+            auto __f = __flight.front();
+            __flight.pop();
+            bool __wrong = __f.guess != __f.real;
+            __p->update_prediction(__wrong,__f.real);
+            if(__wrong) __flight.clear() , __p->clear_pipeline();
+        }
+    });
+    sink += __p->branches();
+}
+
+/* One cycle: insert, broadcast one commit, work and sync. */
+void bench_reservation(size_t __n) {
+    auto __rs = std::make_unique <reservation_station> ();
+    std::mt19937 __gen(3);
+    std::vector <wrapper> __src(4096);
+    for(auto &__w : __src) __w = {(register_type)__gen(),random_index(__gen,40)};
+    measure("reservation_station cycle",__n,[&](size_t i) {
+        if(!__rs->is_full())
+            __rs->insert(ALU_code::ADD,__src[i & 4095],
+                         __src[(i + 1) & 4095],i % FREE);
+        __rs->update({(register_type)i,(uint32_t)(i * 7 % PHYS_FREE)});
+        sink += __rs->work().size();
+        __rs->sync();
+    });
+}
+
+/* One cycle: insert a load, broadcast one commit, work and sync. */
+void bench_memory(size_t __n) {
+    auto __mem = std::make_unique <memory> ();
+    std::mt19937 __gen(4);
+    std::vector <wrapper> __src(4096);
+    for(auto &__w : __src) __w = {(register_type)(__gen() % memory_size),random_index(__gen,60)};
+    measure("memory cycle",__n,[&](size_t i) {
+        if(!__mem->is_full())
+            __mem->insert(0b010,i % FREE,0,__src[i & 4095]);
+        __mem->update({(register_type)(i * 4 % memory_size),(uint32_t)(i * 7 % PHYS_FREE)});
+        sink += __mem->work().size();
+        __mem->sync();
+    });
+}
+
+/* One cycle: insert, mark two entries done, work and sync. */
+void bench_reorder(size_t __n) {
+    auto __rob = std::make_unique <reorder_buffer> ();
+    return_list __list;
+    measure("reorder_buffer cycle",__n,[&](size_t i) {
+        if(!__rob->is_full()) __rob->insert(0,REG_TAG,i & 31,false,0,0);
+        __list.clear();
+        if(__rob->queue.size() > 2) {
+            uint32_t __head = __rob->buffer_head();
+            uint32_t __next = __head + 1 == FREE ? 0 : __head + 1;
+            __list.push_back({(register_type)i,__head});
+            __list.push_back({(register_type)i,__next});
+        }
+        __rob->update(__list);
+        sink += __rob->work().value();
+        __rob->sync();
+    });
+}
+
+}
+
+
+/* Usage: bench_micro [operations] */
+signed main(int argc,const char **argv) {
+    size_t n = argc > 1 ? std::stoull(argv[1]) : 10000000;
+    std::cout << "| Component | Operations | ns/op | cycles/op |\n";
+    std::cout << "| :-------: | :--------: | :---: | :-------: |\n";
+    dark::bench_round_queue(n);
+    dark::bench_predictor(n);
+    dark::bench_reservation(n);
+    dark::bench_memory(n);
+    dark::bench_reorder(n);
+    return 0;
+}
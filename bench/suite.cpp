@@ -0,0 +1,210 @@
+/* Throughput benchmark of the whole simulator over the test suite. */
+#include "../src/cpu.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+
+namespace dark {
+
+/* Stored baseline of one test case. */
+struct baseline {
+    std::string name;       /* Name of the test case. */
+    size_t branches;        /* Expected simulated branches. */
+    size_t clock;           /* Expected simulated clock. */
+    double ips;             /* Committed commands per host second. 0 means unknown. */
+};
+
+/* Result of one test case. */
+struct result {
+    size_t branches;        /* Simulated branches. */
+    size_t clock;           /* Simulated clock. */
+    size_t instructions;    /* Committed commands. */
+    double accuracy;        /* Branch prediction accuracy. */
+    double seconds;         /* Best host time among all runs. */
+};
+
+/**
+ * @brief Read all baselines from file. Lines starting with '#' are
+ * comments, except "# timing N": the timing revision of the clocks.
+ * (0 if not given)
+ */
+std::vector <baseline> read_baseline(const std::string &__path,uint32_t &__timing) {
+    std::vector <baseline> __vec;
+    std::ifstream __in(__path);
+    std::string __line;
+    __timing = 0;
+    while(std::getline(__in,__line)) {
+        if(__line.rfind("# timing ",0) == 0) __timing = std::stoul(__line.substr(9));
+        if(__line.empty() || __line[0] == '#') continue;
+        std::istringstream __s(__line);
+        baseline __b {};
+        if(__s >> __b.name >> __b.branches >> __b.clock) {
+            if(!(__s >> __b.ips)) __b.ips = 0;
+            __vec.push_back(__b);
+        }
+    } return __vec;
+}
+
+/* Write all baselines into file. */
+void write_baseline(const std::string &__path,const std::vector <baseline> &__vec) {
+    std::ofstream __out(__path);
+    __out << "# name branches clock instructions_per_host_second\n";
+    __out << "# timing " << TIMING_REVISION << '\n';
+    for(auto &&__b : __vec)
+        __out << __b.name << ' ' << __b.branches << ' '
+              << __b.clock << ' ' << std::fixed << std::setprecision(0)
+              << __b.ips << '\n';
+}
+
+/* Run one test case for several times. Return false if file is missing. */
+bool run(const std::string &__path,int __repeat,result &__res) {
+    __res.seconds = 1e100;
+    for(int i = 0 ; i != __repeat ; ++i) {
+        if(!freopen(__path.data(),"r",stdin)) return false;
+        auto __cpu = std::make_unique <cpu> ();
+        __cpu->init();
+        auto __beg = std::chrono::steady_clock::now();
+        while(__cpu->work());
+        auto __end = std::chrono::steady_clock::now();
+        double __sec = std::chrono::duration <double> (__end - __beg).count();
+        if(__sec < __res.seconds) __res.seconds = __sec;
+        __res.branches     = __cpu->branches();
+        __res.clock        = __cpu->clock;
+        __res.instructions = __cpu->instructions();
+        __res.accuracy     = __cpu->get_accuracy();
+    } return true;
+}
+
+/* Print the results as the branch predictor table of the README. */
+void print_table(std::ostream &__os,const std::vector <baseline> &__vec,
+                 const std::vector <result> &__res) {
+    __os << "| Test Case      | Total branches | Success Rate | Total CPU clock |\n";
+    __os << "| :------------: | :------------: | :----------: | :-------------: |\n";
+    for(size_t i = 0 ; i != __vec.size() ; ++i) {
+        std::ostringstream __rate;
+        if(__res[i].branches)
+            __rate << std::fixed << std::setprecision(6) << __res[i].accuracy;
+        else __rate << "N/A";
+        __os << "| " << std::left << std::setw(14) << __vec[i].name
+             << " | " << std::setw(14) << __res[i].branches
+             << " | " << std::setw(12) << __rate.str()
+             << " | " << std::setw(15) << __res[i].clock
+             << " |\n" << std::right;
+    }
+}
+
+}
+
+
+/**
+ * Usage: bench_suite [--data DIR] [--baseline FILE]
+ *                    [--repeat N] [--threshold RATIO] [--record] [--strict]
+ *                    [--table]
+ *
+ * Each test case DIR/<name>.data in the baseline is run N times.
+ * The best host time is reported. Simulated clock and branches must
+ * match the baseline exactly, and a baseline of another timing
+ * revision is reported stale. Host throughput lower than baseline by
+ * more than RATIO is a regression. A baseline without throughput (0)
+ * skips that check, unless --strict is given. With --record, the
+ * baseline file is rewritten with current results instead of being
+ * checked. With --table, the clocks are also printed as the branch
+ * predictor table of the README, so both are refreshed in one run.
+ */
+signed main(int argc,const char **argv) {
+    std::string data   = "data";
+    std::string path   = "bench/baseline.txt";
+    int    repeat      = 3;
+    double threshold   = 0.10;
+    bool   record      = false;
+    bool   strict      = false;    /* Fail on unrecorded throughput. */
+    bool   table       = false;    /* Print the README table. */
+
+    for(int i = 1 ; i < argc ; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--record") record = true;
+        else if(arg == "--strict") strict = true;
+        else if(arg == "--table")  table  = true;
+        else if(i + 1 == argc) {
+            std::cerr << "Missing value of " << arg << '\n';
+            return 2;
+        }
+        else if(arg == "--data")      data      = argv[++i];
+        else if(arg == "--baseline")  path      = argv[++i];
+        else if(arg == "--repeat")    repeat    = std::stoi(argv[++i]);
+        else if(arg == "--threshold") threshold = std::stod(argv[++i]);
+        else {
+            std::cerr << "Unknown argument " << arg << '\n';
+            return 2;
+        }
+    }
+
+    uint32_t timing;
+    auto list = dark::read_baseline(path,timing);
+    if(list.empty()) {
+        std::cerr << "No baseline found in " << path << '\n';
+        return 2;
+    }
+
+    int failed = 0;
+    std::vector <dark::result> results;
+    std::cout << "| Test Case | Host time (ms) | Cycles/s | Insts/s | Status |\n";
+    std::cout << "| :-------: | :------------: | :------: | :-----: | :----: |\n";
+    for(auto &&base : list) {
+        dark::result res;
+        if(!dark::run(data + '/' + base.name + ".data",repeat,res)) {
+            std::cout << "| " << base.name << " | - | - | - | MISSING |\n";
+            ++failed;
+            continue;
+        }
+
+        results.push_back(res);
+        double cps = res.clock        / res.seconds;
+        double ips = res.instructions / res.seconds;
+
+        std::string status = "OK";
+        bool        bad    = false;
+        if(record) {
+            base.branches = res.branches;
+            base.clock    = res.clock;
+            base.ips      = ips;
+            status        = "RECORDED";
+        } else if(res.clock != base.clock || res.branches != base.branches) {
+            std::ostringstream __s;
+            if(timing != dark::TIMING_REVISION)
+                __s << "STALE (timing " << timing << ", now "
+                    << dark::TIMING_REVISION << "; use --record) ";
+            __s << "MISMATCH (clock " << res.clock
+                << ", branches " << res.branches << ')';
+            status = __s.str() , bad = true;
+        } else if(!(base.ips > 0)) {
+            status = strict ? "NO THROUGHPUT BASELINE (use --record)"
+                            : "OK (throughput not recorded)";
+            bad    = strict;
+        } else if(ips < base.ips * (1 - threshold)) {
+            std::ostringstream __s;
+            __s << "REGRESSION (" << std::fixed << std::setprecision(1)
+                << 100 * (1 - ips / base.ips) << "% slower)";
+            status = __s.str() , bad = true;
+        } failed += bad;
+
+        std::cout << "| " << base.name
+                  << " | " << std::fixed << std::setprecision(3) << res.seconds * 1000
+                  << " | " << std::scientific << std::setprecision(3) << cps
+                  << " | " << ips
+                  << " | " << status << " |\n";
+    }
+
+    if(record) dark::write_baseline(path,list);
+    if(table && results.size() == list.size()) {
+        std::cout << '\n';
+        dark::print_table(std::cout,list,results);
+    }
+    std::cout << (failed ? "FAILED: " : "All passed: ")
+              << failed << " of " << list.size() << " failed\n";
+    return failed ? 1 : 0;
+}
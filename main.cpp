@@ -1,11 +1,295 @@
 #include "src/cpu.h"
+#include "src/sampler.h"
+#include "src/interval.h"
+#include "src/multicore.h"
+#include "src/lockstep.h"
+#include "src/smt.h"
 
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
 
-signed main() {
+/* Run the program images in lockstep, __n at a time. */
+template <size_t __n>
+void run_lockstep(const std::vector <std::string> &__files) {
+    auto __unit = std::make_unique <dark::lockstep_unit <__n>> ();
+    std::vector <dark::word_utype> __code;
+    for(size_t i = 0 ; i < __files.size() ; i += __n) {
+        size_t __m = std::min(__n,__files.size() - i);
+        for(size_t k = 0 ; k != __m ; ++k) {
+            std::ifstream __in(__files[i + k]);
+            std::stringstream __buf;
+            __buf << __in.rdbuf();
+            if(!__in) std::cerr << "Cannot read " << __files[i + k] << '\n';
+            std::string __str = __buf.str();
+            __unit->load(k,__str.data(),__str.size());
+        }
+        __unit->run();
+        for(size_t k = 0 ; k != __m ; ++k) __code.push_back(__unit->exit_code(k));
+        __unit->reset();
+    }
+
+    fflush(stdout);
+    for(size_t i = 0 ; i != __files.size() ; ++i)
+        printf("%s %u\n",__files[i].data(),__code[i]);
+    std::cerr << "Lockstep: " << __files.size() << " programs, "
+              << __unit->steps << " steps, " << __unit->utilization()
+              << " of " << __n << " lanes used\n";
+}
+
+/**
+ * Usage: code [--sample PERIOD [WARMUP WINDOW]]
+ *             [--interval COUNT [WARMUP]]
+ *             [--harts COUNT [QUANTUM]]
+ *             [--static-hint] [--lvp] [--mem-ports COUNT]
+ *             [--predictor-load FILE] [--predictor-save FILE]
+ *             [--trace FILE] [--trace-cycles LO HI] [--trace-pc LO HI]
+ *             [--cpi] [--loop-buffer] [--store-sets] [--fusion] [--eliminate]
+ *             [--fetch-queue DEPTH] [--dram CHANNELS BANKS]
+ *             [--smt FILE [--smt-fetch rr|icount] [--smt-rob dynamic|partitioned]]
+ *             [--profile FILE] [--profile-folded FILE] [--profile-symbols FILE]
+ *        code --lockstep FILE... [--lanes 8|16]
+ *
+ * With --sample, the program is simulated in sampling mode.
+ * With --interval, COUNT intervals are simulated on parallel threads.
+ * With --harts, COUNT harts share the memory, each on its own thread.
+ * With --smt, the program image in FILE runs as a second thread on the
+ * same core, which picks the thread to fetch round-robin or by ICOUNT
+ * (the default), and splits its RoB dynamically (the default) or in
+ * halves. The output is that of the first thread.
+ * In these modes the statistics are printed to stderr.
+ *
+ * With --static-hint, backward branches start as taken.
+ * With --lvp, load values are predicted and its statistics printed.
+ * With --mem-ports, COUNT loads or stores (at most 4) work at a time.
+ * With --loop-buffer, short loops are fetched from a loop buffer and
+ * the fetches it serves are printed.
+ * With --store-sets, loads go ahead of older stores unless predicted
+ * to depend on them, and the violations are printed.
+ * With --fusion, adjacent pairs of commands are fused into one RoB
+ * entry, and the pairs commited are printed.
+ * With --eliminate, moves, constants and writes to x0 are resolved at
+ * rename without the RS, and the commands eliminated are printed.
+ * With --fetch-queue, a prediction stage runs ahead of fetch through a
+ * fetch target queue, and fetch fills an instruction buffer of DEPTH
+ * (at most 16) slots for issue. Its statistics are printed.
+ * With --dram, loads and stores on the ports take the time of a DRAM
+ * with CHANNELS channels of BANKS banks, and its statistics are printed.
+ * Predictor tables may be preloaded before and dumped after the run.
+ *
+ * With --trace, the pipeline timeline of the main core is written in
+ * O3PipeView format, only for commands fetched in cycles [LO,HI) and
+ * with PC in [LO,HI) if given.
+ *
+ * With --cpi, the clock, branch accuracy and a CPI stack with latency
+ * histograms of the main core are printed to stderr.
+ *
+ * With --profile, a gprof-style flat profile and call graph of guest
+ * functions on the main core are written, with --profile-folded the
+ * folded stacks for flame graphs. Functions are named by the text
+ * symbols of an `nm` listing if given, or by entry PC.
+ *
+ * Built with RISCV_STAGE_TIMING=N, the host time of each pipeline stage
+ * of the main core, timed in one of N cycles, is printed to stderr.
+ *
+ * With --lockstep, the program images in the files are run functionally
+ * in SIMD lanes, and the exit value of each one is printed in order.
+ */
+signed main(int argc,const char **argv) {
     dark::cpu intel_13900KF;    /* For fun LOL */
+    dark::multicore multicore;  /* Shared memory of harts. */
+
+    std::string mode;           /* Simulation mode. */
+    std::vector <size_t> param; /* Parameters of the mode. */
+    std::string load,save;      /* Predictor table files. */
+    std::string smt;            /* Program image of the second thread. */
+    dark::smt_core core;        /* Both threads, with --smt. */
+    bool hint = false;          /* Whether to use static hint. */
+    bool lvp  = false;          /* Whether to predict load values. */
+    bool loop = false;          /* Whether to use loop buffer. */
+    bool sets = false;          /* Whether to predict memory dependence. */
+    bool fuse = false;          /* Whether to fuse pairs of commands. */
+    bool elim = false;          /* Whether to eliminate at rename. */
+    int depth = 0;              /* Depth of instruction buffer. (0 if none) */
+    int channels = 0,banks = 0; /* DRAM geometry. (0 if none) */
+    int ports = 1;              /* Count of memory ports. */
+    std::string trace;          /* Timeline file. */
+    dark::pipeline_tracer tracer;
+    dark::cpi_stack       stack;
+    dark::call_profiler   profiler;
+    std::string profile,folded,symbols; /* Profile files. */
+    bool cpi = false;           /* Whether to print CPI stack. */
+    std::vector <std::string> images; /* Program images to run in lockstep. */
+    size_t lanes = 8;           /* Lanes in lockstep. */
+    for(int i = 1 ; i < argc ; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--static-hint") hint = true;
+        else if(arg == "--lvp") lvp = true;
+        else if(arg == "--cpi") cpi = true;
+        else if(arg == "--loop-buffer") loop = true;
+        else if(arg == "--store-sets") sets = true;
+        else if(arg == "--fusion") fuse = true;
+        else if(arg == "--eliminate") elim = true;
+        else if(arg == "--lanes" && i + 1 < argc) lanes = std::stoul(argv[++i]);
+        else if(arg == "--lockstep")
+            while(i + 1 < argc && argv[i + 1][0] != '-') images.push_back(argv[++i]);
+        else if(arg == "--mem-ports" && i + 1 < argc) ports = std::stoi(argv[++i]);
+        else if(arg == "--fetch-queue" && i + 1 < argc) depth = std::stoi(argv[++i]);
+        else if(arg == "--smt" && i + 1 < argc) smt = argv[++i];
+        else if(arg == "--dram" && i + 2 < argc) {
+            channels = std::stoi(argv[++i]);
+            banks    = std::stoi(argv[++i]);
+        }
+        else if(arg == "--smt-fetch" && i + 1 < argc)
+            core.fetch_policy = std::string(argv[++i]) == "rr" ?
+                dark::smt_core::ROUND_ROBIN : dark::smt_core::ICOUNT;
+        else if(arg == "--smt-rob" && i + 1 < argc)
+            core.rob_policy = std::string(argv[++i]) == "partitioned" ?
+                dark::smt_core::PARTITIONED : dark::smt_core::DYNAMIC;
+        else if(arg == "--predictor-load" && i + 1 < argc) load = argv[++i];
+        else if(arg == "--predictor-save" && i + 1 < argc) save = argv[++i];
+        else if(arg == "--trace" && i + 1 < argc) trace = argv[++i];
+        else if(arg == "--profile" && i + 1 < argc) profile = argv[++i];
+        else if(arg == "--profile-folded" && i + 1 < argc) folded = argv[++i];
+        else if(arg == "--profile-symbols" && i + 1 < argc) symbols = argv[++i];
+        else if(arg == "--trace-cycles" && i + 2 < argc) {
+            tracer.cycle_lo = std::stoull(argv[++i]);
+            tracer.cycle_hi = std::stoull(argv[++i]);
+        } else if(arg == "--trace-pc" && i + 2 < argc) {
+            tracer.pc_lo = std::stoul(argv[++i],nullptr,0);
+            tracer.pc_hi = std::stoul(argv[++i],nullptr,0);
+        }
+        else if(arg.size() > 2 && arg[0] == '-') mode = arg , param.clear();
+        else param.push_back(std::stoull(arg));
+    }
+
+    if(!images.empty()) {
+        if(lanes == 16) run_lockstep <16> (images);
+        else            run_lockstep  <8> (images);
+        return 0;
+    }
+
     intel_13900KF.init();       /* Init data.  */
-    while(intel_13900KF.work());
-    uint32_t result  = (uint8_t)intel_13900KF.a0;
+    if(hint) intel_13900KF.hint_branches();
+    intel_13900KF.lvp_enable = lvp;
+    intel_13900KF.loop_enable = loop;
+    intel_13900KF.ss_enable   = sets;
+    intel_13900KF.fusion_enable = fuse;
+    intel_13900KF.elim_enable   = elim;
+    intel_13900KF.fq_enable = depth > 0;
+    intel_13900KF.fq_depth  = std::clamp <int> (depth,1,dark::fetch_queue::kIB);
+    intel_13900KF.dram_enable = channels > 0;
+    if(channels > 0) intel_13900KF.dram.configure(channels,banks);
+    intel_13900KF.ports = std::clamp(ports,1,dark::memory::kPORTS);
+    if(!load.empty() && !intel_13900KF.predictor::load(load.data()))
+        std::cerr << "Cannot load predictor from " << load << '\n';
+    if(cpi) intel_13900KF.stack = &stack;
+    if(!profile.empty() || !folded.empty()) intel_13900KF.profile = &profiler;
+    if(!symbols.empty() && !profiler.load_symbols(symbols.data()))
+        std::cerr << "Cannot read symbols from " << symbols << '\n';
+    if(!trace.empty()) {
+        if(tracer.open(trace.data())) intel_13900KF.trace = &tracer;
+        else std::cerr << "Cannot open trace file " << trace << '\n';
+    }
+
+    if(!smt.empty()) {
+        std::ifstream __in(smt);
+        std::stringstream __buf;
+        __buf << __in.rdbuf();
+        if(!__in) std::cerr << "Cannot read " << smt << '\n';
+        std::string __str = __buf.str();
+        core.init(intel_13900KF,__str.data(),__str.size());
+        core.run();
+        core.print(std::cerr);
+    } else if(mode == "--sample" && param.size() >= 1) {
+        dark::sampler sampler;
+        sampler.period = param[0];
+        if(param.size() >= 3) {
+            sampler.warmup = param[1];
+            sampler.window = param[2];
+        }
+        sampler.run(intel_13900KF);
+        sampler.print(std::cerr);
+    } else if(mode == "--interval" && param.size() >= 1) {
+        dark::interval_simulator interval;
+        interval.intervals = param[0];
+        if(param.size() >= 2) interval.warmup = param[1];
+        interval.run(intel_13900KF);
+        interval.print(std::cerr);
+    } else if(mode == "--harts" && param.size() >= 1) {
+        if(param.size() >= 2) multicore.quantum = param[1];
+        multicore.init(intel_13900KF,param[0]);
+        multicore.run();
+        multicore.print(std::cerr);
+    } else while(intel_13900KF.work());
+
+    if(lvp) std::cerr << "Load value prediction: coverage "
+                      << intel_13900KF.lvp_coverage() << ", accuracy "
+                      << intel_13900KF.lvp_accuracy() << '\n';
+
+    if(loop) std::cerr << "Loop buffer: " << intel_13900KF.loop_count[1]
+                       << " of " << intel_13900KF.loop_count[0]
+                       << " fetches saved, coverage "
+                       << intel_13900KF.loop_coverage() << '\n';
+
+    if(sets) std::cerr << "Store sets: " << intel_13900KF.ss_count[0]
+                       << " loads ahead of stores, "
+                       << intel_13900KF.ss_count[1] << " violations\n";
+
+    if(fuse) std::cerr << "Fusion: " << intel_13900KF.fusion_count
+                       << " pairs, " << 2.0 * intel_13900KF.fusion_count /
+                          std::max <size_t> (intel_13900KF.instructions(),1)
+                       << " of commands fused\n";
+
+    if(elim) std::cerr << "Eliminated: " << intel_13900KF.elim_count[2]
+                       << " moves, " << intel_13900KF.elim_count[1]
+                       << " constants, " << intel_13900KF.elim_count[0]
+                       << " writes to x0\n";
+
+    if(depth > 0) std::cerr << "Front end: IB occupancy "
+                            << double(intel_13900KF.fq_count[2]) /
+                               std::max <size_t> (intel_13900KF.clock,1)
+                            << ", issue starved " << intel_13900KF.fq_count[0]
+                            << " cycles, fetched in " << intel_13900KF.fq_count[1]
+                            << " blocked cycles\n";
+
+    if(channels > 0) intel_13900KF.dram.print(std::cerr);
+
+    if(cpi) {
+        std::cerr << "Clock: " << intel_13900KF.clock
+                  << ", branches " << intel_13900KF.branches()
+                  << ", accuracy " << intel_13900KF.get_accuracy() << '\n';
+        stack.print(std::cerr,intel_13900KF.instructions(),intel_13900KF.clock);
+    }
+
+#ifdef RISCV_STAGE_TIMING
+    intel_13900KF.timing.print(std::cerr);
+#endif
+
+    if(intel_13900KF.profile) {
+        profiler.finish(intel_13900KF.clock);
+        std::ofstream __out;
+        if(!profile.empty()) {
+            __out.open(profile);
+            if(__out) profiler.print(__out);
+            else std::cerr << "Cannot open profile file " << profile << '\n';
+            __out.close();
+        }
+        if(!folded.empty()) {
+            __out.open(folded);
+            if(__out) profiler.print_folded(__out);
+            else std::cerr << "Cannot open profile file " << folded << '\n';
+        }
+    }
+
+    if(!save.empty() && !intel_13900KF.predictor::save(save.data()))
+        std::cerr << "Cannot save predictor to " << save << '\n';
+
+    intel_13900KF.device().flush();
+    /* Exit through the device: report its code as exit status. */
+    if(intel_13900KF.is_exit()) return intel_13900KF.device().exit_code;
+    uint32_t result  = (uint8_t)intel_13900KF.arch(10);
     printf("%u",result);
     return 0;
 }
@@ -31,6 +31,9 @@ struct arithetic_logic_unit {
             case ALU_code::XOR : return             __reg1  ^ __reg2;
             case ALU_code::OR  : return             __reg1  | __reg2;
             case ALU_code::AND : return             __reg1  & __reg2;
+            case ALU_code::SH1ADD : return (__reg1 << 1) + __reg2;
+            case ALU_code::SH2ADD : return (__reg1 << 2) + __reg2;
+            case ALU_code::SH3ADD : return (__reg1 << 3) + __reg2;
             default: return 0; /* This should never happen. */
         }
     }
@@ -39,6 +42,27 @@ struct arithetic_logic_unit {
 using ALU_type = arithetic_logic_unit;
 
 
+/* Read-modify-write part of atomic memory operations. */
+struct atomic_unit {
+    /* New memory value from old memory value and register. */
+    static register_type work (register_type __mem,
+                               register_type __reg,
+                               AMO_code      __code) noexcept {
+        switch(__code) {
+            case AMO_code::ADD  : return __mem + __reg;
+            case AMO_code::XOR  : return __mem ^ __reg;
+            case AMO_code::OR   : return __mem | __reg;
+            case AMO_code::AND  : return __mem & __reg;
+            case AMO_code::MIN  : return (word_stype)__mem < (word_stype)__reg ? __mem : __reg;
+            case AMO_code::MAX  : return (word_stype)__mem > (word_stype)__reg ? __mem : __reg;
+            case AMO_code::MINU : return __mem < __reg ? __mem : __reg;
+            case AMO_code::MAXU : return __mem > __reg ? __mem : __reg;
+            default             : return __reg; /* SWAP. */
+        }
+    }
+};
+
+
 
 }
 
@@ -0,0 +1,113 @@
+#ifndef _RISC_V_CPI_STACK_H_
+#define _RISC_V_CPI_STACK_H_
+
+#include "utility.h"
+
+#include <iomanip>
+
+namespace dark {
+
+/**
+ * @brief Top-down cycle accounting. Every cycle is charged to what
+ * limited commit in it, and issue-to-commit latency is collected
+ * in log2 histograms for each class of commands.
+ *
+ */
+struct cpi_stack {
+    /* What limited commit in a cycle. */
+    enum cause : int {
+        BASE,       /* A command was commited. */
+        FRONTEND,   /* RoB empty: jalr lock or no valid fetch. */
+        RECOVERY,   /* RoB empty: refilling after a misprediction. */
+        LOAD,       /* Head is a load in flight. */
+        STORE,      /* Head is a load waiting for a store on the port. */
+        ALU,        /* Head waits for an ALU result. */
+        ATOMIC,     /* Head is an atomic waiting to be performed. */
+        CAUSES
+    };
+
+    /* Class of a command, for latency histograms. */
+    enum kind : byte_utype {
+        K_ALU, K_BRANCH, K_LOAD, K_STORE, K_JUMP, K_ATOMIC, K_OTHER, KINDS
+    };
+
+    static constexpr int kBUCKETS = 12; /* 1, 2-3, 4-7 ... 2048 and more. */
+
+    size_t cycles[CAUSES] = {};         /* Cycles of each cause. */
+    size_t full = 0;                    /* Cycles with the RoB full. */
+    size_t latency[KINDS][kBUCKETS] = {};   /* Log2 histograms. */
+    size_t total[KINDS] = {};               /* Sum of latency. */
+    size_t count[KINDS] = {};               /* Commands commited. */
+
+    byte_utype type[32];    /* Class of the command in a RoB position. */
+    size_t     issued[32];  /* Issue cycle of it. */
+    bool recovering = false;/* Whether refilling after a misprediction. */
+
+    /* Class of a command by its suc code. */
+    static kind classify(suc_code __suc) noexcept {
+        switch(__suc) {
+            case suc_code::rcode :
+            case suc_code::icode : return K_ALU;
+            case suc_code::bcode : return K_BRANCH;
+            case suc_code::lcode : return K_LOAD;
+            case suc_code::scode : return K_STORE;
+            case suc_code::jal   :
+            case suc_code::jalr  : return K_JUMP;
+            case suc_code::acode : return K_ATOMIC;
+            default              : return K_OTHER;
+        }
+    }
+
+    /* A command is issued into RoB position __pos. */
+    void issue(int __pos,suc_code __suc,size_t __clock) noexcept {
+        type[__pos]   = classify(__suc);
+        issued[__pos] = __clock;
+        recovering    = false;
+    }
+
+    /* The command in RoB position __pos is commited. */
+    void commit(int __pos,size_t __clock) noexcept {
+        size_t __lat = __clock - issued[__pos];
+        int    __k   = type[__pos];
+        int    __b   = 0;
+        while(__b + 1 != kBUCKETS && (size_t(2) << __b) <= __lat) ++__b;
+        ++latency[__k][__b];
+        total[__k] += __lat;
+        ++count[__k];
+    }
+
+    /* Mispredicted: cycles with an empty RoB are recovery till next issue. */
+    void recover() noexcept { recovering = true; }
+
+    /* Print the CPI breakdown and the histograms. */
+    void print(std::ostream &__os,size_t __insts,size_t __clock) const {
+        static const char *const kCAUSE[CAUSES] = {
+            "base","front-end","recovery","load","store","alu","atomic"
+        };
+        static const char *const kKIND[KINDS] = {
+            "alu","branch","load","store","jump","atomic","other"
+        };
+        double __n = __insts ? __insts : 1;
+        __os << std::fixed << std::setprecision(4)
+             << "CPI: " << __clock / __n << " (" << __insts << " commands)\n";
+        for(int i = 0 ; i != CAUSES ; ++i)
+            __os << "  " << std::left << std::setw(10) << kCAUSE[i] << std::right
+                 << ' ' << cycles[i] / __n << "  " << std::setprecision(1)
+                 << 100.0 * cycles[i] / (__clock ? __clock : 1) << "%\n"
+                 << std::setprecision(4);
+        __os << "  RoB full (overlaps above) " << full / __n << '\n';
+
+        __os << "Issue-to-commit latency (cycles, buckets 1, 2-3, 4-7 ...):\n";
+        for(int k = 0 ; k != KINDS ; ++k) {
+            if(!count[k]) continue;
+            __os << "  " << std::left << std::setw(7) << kKIND[k] << std::right
+                 << " mean " << std::setprecision(2) << double(total[k]) / count[k] << " |";
+            for(int b = 0 ; b != kBUCKETS ; ++b) __os << ' ' << latency[k][b];
+            __os << '\n';
+        } __os << std::defaultfloat;
+    }
+};
+
+}
+
+#endif
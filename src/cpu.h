@@ -8,8 +8,17 @@
 #include "instruction.h"
 #include "reservation.h"
 #include "predictor.h"
+#include "value_predictor.h"
+#include "loop_buffer.h"
+#include "store_set.h"
+#include "fusion.h"
+#include "elimination.h"
+#include "fetch_queue.h"
+#include "stage_timer.h"
+#include "tracer.h"
+#include "cpi_stack.h"
+#include "profiler.h"
 
-#include <functional>
 #include <random>
 
 namespace dark {
@@ -18,48 +27,104 @@ namespace dark {
  * @brief A simple CPU simulator with instruction unit.
  * 
  */
-struct cpu : memory,register_file,reservation_station,reorder_buffer,predictor {
+struct cpu : memory,register_file,reservation_station,reorder_buffer,predictor,
+             value_predictor,loop_buffer,store_set,macro_fusion,fetch_queue,
+             rename_elimination {
     bus            flow;        /* Data flow. */
     size_t        clock = 0;    /* Internal clock. */
     instruction current;        /* Current command. */
     instruction nextcmd;        /* New instruction to fetch. */
+    instruction second;         /* Second command of the current pair. */
+    instruction secondcmd;      /* Second command of the pair fetched. */
 
     bool  prediction_cur; /* Prediction from this cycle. */
     bool  prediction_pre; /* Prediction from prev cycle. */
+    int   predict_cur = 0; /* Index of prediction from this cycle. */
+    int   predict_pre = 0; /* Index of prediction from prev cycle. */
+
+    byte_utype fusion_cur = 0; /* Kind of the pair fetched in this cycle. */
+    byte_utype fusion_pre = 0; /* Kind of the pair fetched in prev cycle. */
+
+    byte_utype branch_slot[32]; /* Index of prediction of a branch in RoB. */
 
     bool   jalr_lock = 0; /* Whether there is a jalr command issued. */
     bool   full_lock = 0; /* Whether this issue is blocked by full. */
 
+    bool  drain_lock = 0; /* Whether fetch is stopped to drain.  */
+    bool    smt_turn = 1; /* Whether the front end is ours in this cycle. */
+    int    rob_limit = FREE;  /* Commands this thread may hold in RoB. */
+
     bool   fetch_pre = 0; /* Whether fetch is available.  */
     bool   fetch_cur = 0; /* Whether current fetch work.  */
 
     address_type  pc_pre   = 0; /* PC in last cycle. */
     address_type  pc_delta = 0; /* The delta of PC in each cycle. */
+    address_type atomic_addr = 0; /* Address of the atomic performed. */
+
+    pipeline_tracer *trace = nullptr; /* Timeline output, if any. */
+    cpi_stack       *stack = nullptr; /* Cycle accounting, if any. */
+    call_profiler *profile = nullptr; /* Call-graph profile, if any. */
+#ifdef RISCV_STAGE_TIMING
+    stage_timer     timing;           /* Host time by stage. */
+#endif
 
     size_t prediction_count; /* Count of all predictions. */
     size_t prediction_wrong; /* Wrong rate. */
 
 
-    /* Whether the command  */
-    bool is_terminal() const noexcept
-    { return jalr_lock && reorder_buffer::empty(); }
+    /* Whether the program has terminated. */
+    bool is_terminal() const noexcept {
+        return memory::is_exit() ||
+            (jalr_lock && reorder_buffer::empty());
+    }
 
     /* Whether the command is issuable. */
-    bool issueable() const noexcept { return !reorder_buffer::is_full(); }
+    bool issueable() const noexcept {
+        return reorder_buffer::queue.size() < rob_limit && !register_file::free_list.empty();
+    }
+
+    /* Fetch the command at __pc, through the loop buffer if enabled. */
+    void fetch_command(address_type __pc,command_type &__cmd) noexcept {
+        if(!loop_enable) return memory::fetch(__pc,__cmd);
+        if(loop_fetch(__pc,__cmd)) return;
+        memory::fetch(__pc,__cmd);
+        loop_watch(__pc,__cmd);
+    }
 
     /**
      * @brief Do fetch operation iff not locked.
      * 
      */
     void work_fetch() noexcept {
-        if(jalr_lock) return void(fetch_cur = false);
+        if(!smt_turn) return;   /* Frozen: the other thread fetches. */
+        if(fq_enable) return work_front_end();
+        if(jalr_lock || drain_lock) return void(fetch_cur = false);
         fetch_cur = true;       /* This tag may go invalid in future. */
         if(full_lock) return;   /* Locked by full,so no need fetching. */
-        fetch(nextcmd.command); /* Fetch one command at a time. */
-
-        if(nextcmd.suc == suc_code::jal) {
+        /* Fetch one command at a time, or a pair to fuse. */
+        fetch_command(pc,nextcmd.command);
+        fusion_cur = macro_fusion::NONE;
+        if(fusion_enable && macro_fusion::may_lead(nextcmd)) {
+            memory::fetch(pc + 4,secondcmd.command);
+            fusion_cur = macro_fusion::fusible(nextcmd,secondcmd);
+            if(fusion_cur && loop_enable) fetch_command(pc + 4,secondcmd.command);
+        }
+        if(trace) trace->fetch(clock);
+
+        if(fusion_cur) {
+            pc_delta = 8;
+            if(fusion_cur == macro_fusion::AUIPC_JALR) {
+                address_type __to = (pc + nextcmd.U_immediate() + secondcmd.I_immediate()) & ~1;
+                pc_delta = __to - pc;
+            } else if(fusion_cur == macro_fusion::CMP_BRANCH) {
+                predict_cur = predictor::uncommited.tail();
+                if(bool(prediction_cur = predict(pc + 4)))
+                    pc_delta = 4 + secondcmd.B_immediate();
+            }
+        } else if(nextcmd.suc == suc_code::jal) {
             pc_delta = nextcmd.J_immediate();
         } else if(nextcmd.suc == suc_code::bcode) {
+            predict_cur = predictor::uncommited.tail();
             if(bool(prediction_cur = predict(pc)))
                 pc_delta = nextcmd.B_immediate();
             else /* No jump case. */
@@ -67,15 +132,106 @@ struct cpu : memory,register_file,reservation_station,reorder_buffer,predictor {
         } else pc_delta = 4;
     }
 
+    /* Decoupled front end: prediction, then fetch from the FTQ. */
+    void work_front_end() noexcept {
+        if(drain_lock) {    /* Fetch again from the oldest later. */
+            reset_pc(fq_oldest(pc));
+            fetch_queue::fq_flush();
+            return void(fetch_cur = false);
+        }
+        if(full_lock && !ib.full()) ++fq_count[1];
+        fq_count[2] += ib.size();
+        work_predict();
+        while(ib_count != kWIDTH && !ftq.empty() && ib.size() + ib_count < fq_depth)
+            work_fetch_slot(ib_new[ib_count++]);
+        fetch_cur = true;
+    }
+
+    /* Prediction stage: put the next block into the FTQ, if room. */
+    void work_predict() noexcept {
+        if(fq_stop || ftq.full()) return;
+        fetch_target __t = {pc,0,false,0};
+        address_type __pc = pc;
+        while(__t.size < kBLOCK) {
+            instruction __a,__b;
+            memory::fetch(__pc,__a.command);
+            byte_utype __kind = macro_fusion::NONE;
+            if(fusion_enable && macro_fusion::may_lead(__a)) {
+                memory::fetch(__pc + 4,__b.command);
+                __kind = macro_fusion::fusible(__a,__b);
+            }
+            /* Keep a prediction slot for the branch, or end before it. */
+            bool __branch = __kind == macro_fusion::CMP_BRANCH ||
+                           (!__kind && __a.suc == suc_code::bcode);
+            if(__branch && predictor::uncommited.full()) break;
+            if(__branch) {
+                address_type __at = __kind ? __pc + 4 : __pc;
+                instruction  __br = __kind ? __b : __a;
+                __t.predict = predictor::uncommited.tail();
+                __t.prediction = predict(__at);
+                __t.size += __kind ? 2 : 1;
+                __pc = __at + (__t.prediction ? __br.B_immediate() : 4);
+                break;
+            }
+            if(__kind == macro_fusion::AUIPC_JALR) {
+                __t.size += 2;
+                __pc = (__pc + __a.U_immediate() + __b.I_immediate()) & ~1;
+                break;
+            }
+            if(__kind) { __t.size += 2 , __pc += 8; continue; }
+
+            ++__t.size;
+            if(__a.suc == suc_code::jal) { __pc += __a.J_immediate(); break; }
+            if(__a.suc == suc_code::jalr || __a.command == 0x0ff00513) {
+                fq_stop = true;     /* Wait for the target. */
+                break;
+            } __pc += 4;
+        }
+        if(!__t.size) return;
+        ftq.push(__t);
+        pc = __pc;
+    }
+
+    /* Fetch stage: fetch the next slot of the FTQ head block. */
+    void work_fetch_slot(fetch_slot &__s) noexcept {
+        auto &__t = ftq.front();
+        __s.pc = __t.pc + 4 * fq_offset;
+        __s.fetched = clock;
+        fetch_command(__s.pc,__s.cmd.command);
+        __s.fusion = macro_fusion::NONE;
+        if(fusion_enable && fq_offset + 1 < __t.size && macro_fusion::may_lead(__s.cmd)) {
+            memory::fetch(__s.pc + 4,__s.second.command);
+            __s.fusion = macro_fusion::fusible(__s.cmd,__s.second);
+            if(__s.fusion && loop_enable) fetch_command(__s.pc + 4,__s.second.command);
+        }
+        fq_offset += __s.fusion ? 2 : 1;
+        if(fq_offset != __t.size) return;
+        __s.prediction = __t.prediction;
+        __s.predict    = __t.predict;
+        ftq.pop();
+        fq_offset = 0;
+    }
+
     /**
      * @brief Reset PC when BRANCH failed or JALR.
-     * 
+     * The front end (if used) predicts again from there.
      */
-    void reset_pc(address_type __pc) noexcept { pc = __pc; }
+    void reset_pc(address_type __pc) noexcept { pc = __pc , fq_stop = false; }
 
     /* Clear all the instruction when prediction fail. */
-    void clear_instruction() noexcept
-    { jalr_lock = fetch_pre = fetch_cur = full_lock = false; }
+    void clear_instruction() noexcept {
+        jalr_lock = fetch_pre = fetch_cur = full_lock = false;
+        fetch_queue::fq_flush();
+    }
+
+    /* Throw away the command fetched in this cycle. */
+    void drop_fetch() noexcept {
+        if(fq_enable) return; /* Prediction stops at jalr: none fetched. */
+        if(fetch_cur && (nextcmd.suc == suc_code::bcode ||
+                         fusion_cur == macro_fusion::CMP_BRANCH))
+            predictor::cancel_last();
+        fetch_cur = false;
+    }
 
     /**
      * @brief Synchronize the one command issued at a time.
@@ -83,15 +239,28 @@ struct cpu : memory,register_file,reservation_station,reorder_buffer,predictor {
      * @attention Use it in the end of a cycle.
      */
     void sync_issue() noexcept {
-        if(!fetch_pre)   return void(full_lock = false);
+        if(!smt_turn) return;
+        if(fq_enable) {
+            if(ib.empty()) return ++fq_count[0] , void(full_lock = false);
+            auto &__s = ib.front();
+            current        = __s.cmd;
+            second         = __s.second;
+            fusion_pre     = __s.fusion;
+            pc_pre         = __s.pc;
+            prediction_pre = __s.prediction;
+            predict_pre    = __s.predict;
+            if(trace) trace->fetched_pre = __s.fetched;
+        } else if(!fetch_pre) return void(full_lock = false);
+
+        /* Drain case: give up current command and fetch it again later. */
+        if(drain_lock) return reset_pc(pc_pre) , void(full_lock = false);
         if(!issueable()) return void(full_lock = true );
 
         /* Terminal command case. */
         if(current.command == 0x0ff00513) {
             jalr_lock = true;
             full_lock = true;
-            fetch_cur = false;
-            return;
+            return drop_fetch();
         }   full_lock = false;
 
         word_utype __arg  = 0;
@@ -100,15 +269,31 @@ struct cpu : memory,register_file,reservation_station,reorder_buffer,predictor {
         word_utype __done = false;
         word_utype __tail = reorder_buffer::buffer_tail();
         ALU_code   __code = (ALU_code)current.mid;
-
-        switch(current.suc) {
+        bool      __guess = false;  /* Whether load value is guessed. */
+        register_type __value = 0;  /* Load value guessed. */
+        word_utype __src  = 0;      /* Source of a move eliminated. */
+        auto      &__elim = rename_elimination::elim[__tail];
+
+        macro_fusion::fused[__tail] = {};
+        __elim = rename_elimination::NONE;
+        if(fusion_pre) {
+            if(register_file::free_list.size() < 2) return void(full_lock = true);
+            issue_pair(__arg,__tag,__dest,__done);
+        } else if(elim_enable && (__elim = eliminable(current,__src,__arg))) {
+            __done = true;  /* Resolved here: no RS, no ALU. */
+        } else switch(current.suc) {
             case suc_code::lcode :
                 memory::insert(
                     current.mid,
                     __tail,
                     current.I_immediate(),
-                    register_file::reorder(current.rs1)
-                ); break;
+                    register_file::reorder(current.rs1),
+                    store_set::ss_enable ?
+                        store_set::ss_load(pc_pre,__tail,memory::last) : memory::last
+                );
+                if(value_predictor::lvp_enable && __dest)
+                    __guess = value_predictor::guess(pc_pre,__tail,__value);
+                break;
 
             case suc_code::scode :
                 __arg  = current.command;
@@ -116,12 +301,16 @@ struct cpu : memory,register_file,reservation_station,reorder_buffer,predictor {
                 __dest = 0;
                 __done = true;
                 memory::insert_store(reorder_buffer::buffer_tail());
+                if(store_set::ss_enable) store_set::ss_store(pc_pre,__tail);
                 break;
 
             case suc_code::bcode :
                 __tag  = BRANCH_TAG;
                 __arg  = pc_pre + (prediction_pre ? 4 : current.B_immediate());
                 __dest = prediction_pre;
+                branch_slot[__tail] = predict_pre;
+                register_file::checkpoint(__tail);
+                memory::checkpoint(__tail);
                 reservation_station::insert(
                     B_ALU_map[current.mid],
                     register_file::reorder(current.rs1),
@@ -143,7 +332,7 @@ struct cpu : memory,register_file,reservation_station,reorder_buffer,predictor {
 
             case suc_code::jalr  :  /* Special immediate command. */
                 jalr_lock = true;   /* Trigger lock. */
-                fetch_cur = false;  /* Current fecth becomes invalid. */
+                drop_fetch();       /* Current fecth becomes invalid. */
                 __tag     = JALR_TAG;
                 __code    = ALU_code::ADD;
             case suc_code::icode :
@@ -152,7 +341,7 @@ struct cpu : memory,register_file,reservation_station,reorder_buffer,predictor {
                 reservation_station::insert(
                     __code,
                     register_file::reorder(current.rs1),
-                    wrapper{current.I_immediate(),FREE},
+                    wrapper{current.I_immediate(),PHYS_FREE},
                     reorder_buffer::buffer_tail()
                 ); break;
 
@@ -161,6 +350,25 @@ struct cpu : memory,register_file,reservation_station,reorder_buffer,predictor {
                 __done = true;
                 break;
 
+            case suc_code::acode :  /* Performed at the head of RoB. */
+                __arg  = current.command;
+                __tag  = ATOMIC_TAG;
+                memory::insert_store(reorder_buffer::buffer_tail());
+                if(store_set::ss_enable) store_set::ss_store(pc_pre,__tail);
+                break;
+
+            case suc_code::fence :  /* Memory is always in order. */
+                __dest = 0;
+                __done = true;
+                break;
+
+            case suc_code::scall :  /* Only CSR reading is supported. */
+                if(current.mid == 0) return void(full_lock = true);
+                if(current.I_imm_11_00 == CSR_MHARTID)
+                    __arg = register_file::hartid;
+                __done = true;
+                break;
+
             case suc_code::auipc : __arg = pc_pre;
             case suc_code::lui   :
                 __arg += current.U_immediate();
@@ -171,73 +379,390 @@ struct cpu : memory,register_file,reservation_station,reorder_buffer,predictor {
             default: return void(full_lock = true); 
         }
 
-        /* Require updating register. */
-        if(__tag == REG_TAG || __tag == JALR_TAG)
-            register_file::insert(
-                __dest,
-                reorder_buffer::buffer_tail()
-            );
-        reorder_buffer::insert(__arg,__tag,__dest,__done);
+        /* Require updating register: rename after reading sources. */
+        byte_utype __phys = 0;
+        byte_utype __old  = 0;
+        if(__elim == rename_elimination::MOVE)
+            __phys = register_file::alias(__dest,__src,__old);
+        else if(__tag == REG_TAG || __tag == JALR_TAG || __tag == ATOMIC_TAG)
+            __phys = register_file::rename(__dest,__old);
+
+        /* Results known at issue are written at once. */
+        if(__tag == JALR_TAG)
+            register_file::write(__phys,pc_pre + 4);
+        else if(__done && __tag == REG_TAG && __elim != rename_elimination::MOVE)
+            register_file::write(__phys,__arg);
+        else if(__guess)
+            register_file::write(__phys,__value);
+        reorder_buffer::insert(__arg,__tag,__dest,__done,__phys,__old);
+        memory::read_log[__tail].done = false;
+        if(trace) trace->issue(__tail,pc_pre,current.command,clock,__done);
+        if(!fusion_pre) {
+            if(stack) stack->issue(__tail,current.suc,clock);
+            if(profile) profile->issue(__tail,pc_pre,current.command);
+        } else {
+            if(stack) stack->issue(__tail,second.suc,clock);
+            if(profile) profile->issue(__tail,pc_pre + 4,second.command,true,
+                (pc_pre + current.U_immediate() + second.I_immediate()) & ~1);
+        }
+        if(fq_enable) ib.pop();
+    }
+
+    /**
+     * @brief Issue the pair in current and second as one RoB entry,
+     * which stands for the second. The first gets its own register
+     * only if the second does not overwrite it.
+     */
+    void issue_pair(word_utype &__arg,word_utype &__tag,
+                    word_utype &__dest,word_utype &__done) noexcept {
+        word_utype __tail = reorder_buffer::buffer_tail();
+        auto &__f = macro_fusion::fused[__tail];
+        __f.pair = true;
+        __dest   = second.rd;
+
+        switch(fusion_pre) {
+            case macro_fusion::LUI_ADDI   :
+            case macro_fusion::AUIPC_ADDI :
+            case macro_fusion::AUIPC_JALR : {
+                register_type __hi = current.U_immediate();
+                if(current.suc == suc_code::auipc) __hi += pc_pre;
+                if(current.rd != second.rd) {
+                    __f.dest = current.rd;
+                    __f.phys = register_file::rename(current.rd,__f.old);
+                    register_file::write(__f.phys,__hi);
+                }
+                __arg  = fusion_pre == macro_fusion::AUIPC_JALR ?
+                         pc_pre + 8 : __hi + second.I_immediate();
+                __done = true;
+            } break;
+
+            case macro_fusion::SHIFT_ADD :
+                reservation_station::insert(
+                    ALU_code(int(ALU_code::SH1ADD) + current.rs2 - 1),
+                    register_file::reorder(current.rs1),
+                    register_file::reorder(
+                        second.rs1 == current.rd ? second.rs2 : second.rs1),
+                    __tail
+                ); break;
+
+            case macro_fusion::CMP_BRANCH : {
+                /* beq on the result jumps when the compare fails. */
+                __f.invert = second.mid == 0;
+                ALU_code __code = current.mid == 2 ?
+                    (__f.invert ? ALU_code::GE  : ALU_code::LT) :
+                    (__f.invert ? ALU_code::GEU : ALU_code::LTU);
+                wrapper __lhs = register_file::reorder(current.rs1);
+                wrapper __rhs = {current.I_immediate(),PHYS_FREE};
+                if(current.suc == suc_code::rcode)
+                    __rhs = register_file::reorder(current.rs2);
+
+                /* The compare result is written when the branch is done. */
+                __f.dest = current.rd;
+                __f.phys = register_file::rename(current.rd,__f.old);
+                __tag  = BRANCH_TAG;
+                __arg  = pc_pre + 4 + (prediction_pre ? 4 : second.B_immediate());
+                __dest = prediction_pre;
+                branch_slot[__tail] = predict_pre;
+                register_file::checkpoint(__tail);
+                memory::checkpoint(__tail);
+                reservation_station::insert(__code,__lhs,__rhs,__tail);
+            } break;
+        }
+    }
+
+    /* Write a result into a physical register and wake up its consumers. */
+    void writeback(byte_utype __phys,register_type __val) noexcept {
+        if(!__phys) return;
+        register_file::write(__phys,__val);
+        reservation_station::update({__val,__phys});
+        memory::update({__val,__phys});
     }
 
     /* Flush the bus data. */
     void sync_bus() noexcept {
         /* Commit message is not empty. */
         int __head = reorder_buffer::buffer_head();
+        if(trace && reorder_buffer::sync_tag)
+            trace->retire(__head,clock,reorder_buffer::queue[__head].tag == STORE_TAG);
+        if(profile && reorder_buffer::sync_tag)
+            profile->commit(__head,clock,flow.ReG_update.value());
+        if(reorder_buffer::sync_tag && macro_fusion::fused[__head].pair) {
+            auto &__f = macro_fusion::fused[__head];
+            register_file::commit(__f.dest,__f.phys,__f.old);
+            ++reorder_buffer::committed , ++fusion_count;
+        }
+        if(reorder_buffer::sync_tag && rename_elimination::elim[__head])
+            ++elim_count[rename_elimination::elim[__head] - 1];
         if(!flow.ReG_update.is_empty()) {
+            auto &__top = reorder_buffer::queue[__head];
             switch(flow.ReG_update.tag()) {
                 case JALR_TAG   :
                     jalr_lock = false;
                     reset_pc(flow.ReG_update.pc());
-                    flow.ReG_update.val = pc_pre + 4;
+                    register_file::commit(__top.dest,__top.phys,__top.old);
+                    break;
+
+                case ATOMIC_TAG :
+                    memory::release(__head);
+                    writeback(__top.phys,flow.ReG_update.value());
+                    register_file::commit(__top.dest,__top.phys,__top.old);
+                    if(store_set::ss_enable && check_order(atomic_addr,4)) return;
+                    break;
+
                 case REG_TAG    :
-                    register_file::commit(
-                        flow.ReG_update.index(),
-                        __head,
-                        flow.ReG_update.value()
-                    ); flow.ReG_update.idx = __head;
-                    reservation_station::update(flow.ReG_update);
-                    memory::update(flow.ReG_update); break;
+                    register_file::commit(__top.dest,__top.phys,__top.old);
+                    /* Wrong load value guessed: run again after the load. */
+                    if(value_predictor::verify(__head,register_file::phys[__top.phys])) {
+                        reset_pc(value_predictor::slots[__head].pc + 4);
+                        predictor::clear_pipeline();
+                        if(stack) stack->recover();
+                        return global_clear();
+                    } break;
 
-                case BRANCH_TAG :
+                case BRANCH_TAG :   /* Recovered in recover_branch(). */
                     predictor::update_prediction(
                         flow.ReG_update.is_wrong(),
                         flow.ReG_update.result()
-                    );
-                    if(flow.ReG_update.is_wrong()) {
-                        reset_pc(flow.ReG_update.pc());
-                        return global_clear();
-                    } break;
+                    ); break;
 
                 case STORE_TAG  : {
                     instruction __inst = {flow.ReG_update.value()};
+                    address_type __addr =
+                        register_file::arch(__inst.rs1) + __inst.S_immediate();
                     memory::store(
                         __inst.mid,
                         __head,
-                        register_file::reg[__inst.rs1] + __inst.S_immediate(),
-                        register_file::reg[__inst.rs2]
+                        __addr,
+                        register_file::arch(__inst.rs2)
                     );
+                    loop_invalidate(__addr,1 << (__inst.mid & 0b11));
+                    if(store_set::ss_enable && check_order(__addr,1 << (__inst.mid & 0b11)))
+                        return;
                 } break;
 
                 default: ;/* This should never happen. */
             }
         } /* Reorder buffer may need updating. */
         reorder_buffer::update(flow.RoB_update);
+        for(auto &&iter : flow.RoB_update) {
+            auto &__e = reorder_buffer::queue[iter.index()];
+            if(__e.tag == REG_TAG) writeback(__e.phys,iter.value());
+            else if(__e.tag == BRANCH_TAG && macro_fusion::fused[iter.index()].pair) {
+                auto &__f = macro_fusion::fused[iter.index()];
+                writeback(__f.phys,(iter.value() ^ __f.invert) & 1);
+            }
+            if(trace) trace->complete(iter.index(),clock);
+        }
+        recover_branch();
         flow.clear();
     }
 
+    /**
+     * @brief Check the store (or atomic) commited at the head against
+     * the loads gone ahead of it. If one of them has read the memory
+     * written, run again after the store.
+     * 
+     * @return Whether the pipeline is flushed.
+     */
+    bool check_order(address_type __addr,size_t __m) noexcept {
+        int __head = reorder_buffer::buffer_head();
+        int __max  = int(reorder_buffer::queue.size()) - 1;
+        store_set::ss_cancel(__head);
+        word_utype __load = memory::conflict(__addr,__m,
+            [this,__max](uint32_t __x) { return reorder_buffer::alive(__x,__max); });
+        if(__load == FREE) return false;
+
+        store_set::ss_violate(__load,__head);
+        reset_pc(store_set::ss_pc[__head] + 4);
+        predictor::clear_pipeline();
+        if(stack) stack->recover();
+        global_clear();
+        return true;
+    }
+
+    /**
+     * @brief Recover at once from the oldest branch resolved wrong in
+     * this cycle. Only the commands after it are squashed, and the
+     * renaming state is restored from its checkpoint.
+     * 
+     * @attention Use it after RoB is updated from the bus.
+     */
+    void recover_branch() noexcept {
+        int __size = reorder_buffer::queue.size();
+        int __best = __size;    /* Age of the oldest wrong branch. */
+        for(auto &&iter : flow.RoB_update) {
+            auto &__e = reorder_buffer::queue[iter.index()];
+            int __age = reorder_buffer::age(iter.index());
+            if(__e.tag == BRANCH_TAG && ((__e.result ^ __e.dest) & 1) && __age < __best)
+                __best = __age;
+        } if(__best == __size) return;
+
+        int __pos = (reorder_buffer::buffer_head() + __best) % reorder_buffer::capacity();
+        auto &__e = reorder_buffer::queue[__pos];
+        auto __alive = [this,__best](uint32_t __x) noexcept
+        { return reorder_buffer::alive(__x,__best); };
+
+        for(int i = __best + 1 ; i < __size ; ++i) {
+            int __x = (__pos + i - __best) % reorder_buffer::capacity();
+            value_predictor::cancel(__x);
+            store_set::ss_cancel(__x);
+            if(rename_elimination::elim[__x] == rename_elimination::MOVE)
+                register_file::unshare(reorder_buffer::queue[__x].phys);
+            if(trace) trace->squash(__x);
+        }
+        reorder_buffer::squash(__best + 1);
+        register_file::restore(__pos);
+        memory::squash(__pos,__alive);
+        reservation_station::squash(__alive);
+        predictor::squash(branch_slot[__pos],__e.result & 1);
+        clear_instruction();
+        reset_pc(__e.result & ~1);
+        if(stack) stack->recover();
+    }
+
+    /**
+     * @brief Perform the atomic command at the head of RoB, if any.
+     * Its result is commited in the next cycle.
+     * 
+     * @attention For a hart, use it only at the quantum barrier.
+     */
+    void work_atomic() noexcept {
+        if(reorder_buffer::empty()) return;
+        auto &__e = reorder_buffer::queue.front();
+        if(__e.tag != ATOMIC_TAG || __e.done) return;
+        instruction __inst = {__e.result};
+        atomic_addr = register_file::arch(__inst.rs1);
+        loop_invalidate(atomic_addr,4);
+        __e.result = memory::atomic(
+            AMO_code(__inst.pre >> 2),
+            register_file::arch(__inst.rs1),
+            register_file::arch(__inst.rs2)
+        ); __e.done = true;
+        if(trace) trace->complete(reorder_buffer::buffer_head(),clock);
+    }
+
     /* Synchronize the insturction unit. */
     void sync_instruction() noexcept {
+        if(!smt_turn) return;
+        if(fq_enable) {
+            fetch_queue::fq_sync();
+            return void(fetch_pre = !ib.empty());
+        }
         /* Only when issue success and fetch sucess. */
         if(fetch_cur && !full_lock) {
             current        = nextcmd;
+            second         = secondcmd;
+            fusion_pre     = fusion_cur;
             prediction_pre = prediction_cur;
+            predict_pre    = predict_cur;
+            if(trace) trace->advance();
             pc_pre         = pc;
             pc            += pc_delta;
         } /* Update both tags. */
         fetch_pre = fetch_cur;
     }
 
+    /* Stop fetching, so that all issued commands get commited. */
+    void drain() noexcept { drain_lock = true; }
+
+    /* Whether the pipeline is empty, with all the state architectural. */
+    bool drained() const noexcept
+    { return !fetch_pre && reorder_buffer::empty(); }
+
+    /* Restart the pipeline from architectural state after draining. */
+    void resume() noexcept {
+        global_clear();
+        predictor::clear_pipeline();
+        drain_lock = false;
+    }
+
+    /**
+     * @brief Static hint pass: bias predictor by the direction of branches.
+     * Only the text is read: commands reachable from the entry, through
+     * both ways of a branch, jal targets and the return of calls. It ends
+     * at a jalr without link, the terminal command or an unknown code, so
+     * data words are never taken as branches. Forward hints go first, so
+     * a backward one wins an entry shared by two branches.
+     */
+    void hint_branches() {
+        std::vector <bool> __seen(memory_size / 4);
+        std::vector <address_type> __work = {0},__branch;
+        while(!__work.empty()) {
+            address_type __pc = __work.back();
+            __work.pop_back();
+            while(__pc % 4 == 0 && __pc + 4 <= memory_size && !__seen[__pc / 4]) {
+                __seen[__pc / 4] = true;
+                instruction __inst;
+                memory_chip::load(__pc,__inst.command,4);
+                if(__inst.command == 0x0ff00513 || !is_command(__inst)) break;
+                if(__inst.suc == suc_code::bcode) {
+                    __branch.push_back(__pc);
+                    __work.push_back(__pc + __inst.B_immediate());
+                } else if(__inst.suc == suc_code::jal) {
+                    if(__inst.rd) __work.push_back(__pc + 4);
+                    __pc += __inst.J_immediate();
+                    continue;
+                } else if(__inst.suc == suc_code::jalr && !__inst.rd) break;
+                __pc += 4;
+            }
+        }
+        for(bool __backward : {false,true})
+            for(auto __pc : __branch) {
+                instruction __inst;
+                memory_chip::load(__pc,__inst.command,4);
+                if((__inst.B_immediate() < 0) == __backward)
+                    predictor::hint(__pc,__backward);
+            }
+    }
+
+    /* Whether the major code of a command is one simulated. */
+    static bool is_command(instruction __inst) noexcept {
+        switch(__inst.suc) {
+            case suc_code::bcode :
+                return B_ALU_map[__inst.mid] != ALU_code::WORKING;
+            case suc_code::lui   : case suc_code::auipc :
+            case suc_code::jal   : case suc_code::jalr  :
+            case suc_code::lcode : case suc_code::scode :
+            case suc_code::icode : case suc_code::rcode :
+            case suc_code::acode : case suc_code::fence :
+            case suc_code::scall : return true;
+            default: return false;
+        }
+    }
+
+    /**
+     * @brief Reset to the state of a new cpu. Only the written pages
+     * of memory are zeroed, which is much cheaper than a new cpu.
+     * All options go back to default, and the observers are detached.
+     */
+    void reset() noexcept {
+        memory::reset();
+        static_cast <register_file       &> (*this) = register_file();
+        static_cast <reservation_station &> (*this) = reservation_station();
+        static_cast <reorder_buffer      &> (*this) = reorder_buffer();
+        static_cast <predictor           &> (*this) = predictor();
+        static_cast <value_predictor     &> (*this) = value_predictor();
+        static_cast <loop_buffer         &> (*this) = loop_buffer();
+        static_cast <store_set           &> (*this) = store_set();
+        static_cast <macro_fusion        &> (*this) = macro_fusion();
+        static_cast <fetch_queue         &> (*this) = fetch_queue();
+        static_cast <rename_elimination  &> (*this) = rename_elimination();
+        flow.clear();
+        clock   = 0;
+        current = nextcmd = second = secondcmd = instruction {0};
+        fusion_cur = fusion_pre = 0;
+        prediction_cur = prediction_pre = false;
+        predict_cur    = predict_pre    = 0;
+        jalr_lock = full_lock = drain_lock = false;
+        smt_turn  = true , rob_limit = FREE;
+        fetch_pre = fetch_cur = false;
+        pc_pre = pc_delta = 0;
+        trace = nullptr , stack = nullptr , profile = nullptr;
+#ifdef RISCV_STAGE_TIMING
+        timing = stage_timer();
+#endif
+    }
+
     /* Clear all the pipelines. */
     void global_clear() noexcept {
         flow.clear();
@@ -246,49 +771,111 @@ struct cpu : memory,register_file,reservation_station,reorder_buffer,predictor {
         register_file::clear_pipeline();
         reorder_buffer::clear_pipeline();
         reservation_station::clear_pipeline();
+        value_predictor::clear_pipeline();
+        store_set::clear_pipeline();
+        if(trace) trace->flush();
     }
 
-    /* Global synchronize. */
+    /* Global synchronize. (__timed: whether to time the stages) */
+    template <bool __timed = false>
     void global_sync() noexcept {
-        sync_issue();
-        sync_bus();
-        sync_instruction();
+        { RISCV_STAGE(SYNC_ISSUE);       sync_issue(); }
+        { RISCV_STAGE(SYNC_BUS);         sync_bus(); }
+        { RISCV_STAGE(SYNC_INSTRUCTION); sync_instruction(); }
         /* Order of 3 functions above can't change! */
-        memory::sync();
-        reorder_buffer::sync();
-        reservation_station::sync();
+        { RISCV_STAGE(SYNC_MEMORY);      memory::sync(); }
+        if(trace) trace_loads();
+        { RISCV_STAGE(SYNC_ROB);         reorder_buffer::sync(); }
+        { RISCV_STAGE(SYNC_RS);          reservation_station::sync(); }
+        if(!memory::shared) { RISCV_STAGE(ATOMIC); work_atomic(); }
+    }
+
+    /* Record the loads which start on a port in this cycle. */
+    void trace_loads() noexcept {
+        for(int i = 0 ; i != memory::ports ; ++i) {
+            auto &__u = memory::port[i];
+            if(__u.load_tag && __u.cc == memory::kLATENCY - 1)
+                trace->execute(__u.current.dest,clock);
+        }
+    }
+
+    /* Charge this cycle to what limits commit. Use it before sync. */
+    void account() noexcept {
+        auto &__s = *stack;
+        int __head = reorder_buffer::buffer_head();
+        if(reorder_buffer::is_full()) ++__s.full;
+        if(reorder_buffer::sync_tag) {
+            __s.commit(__head,clock);
+            return void(++__s.cycles[cpi_stack::BASE]);
+        }
+        if(reorder_buffer::empty()) {
+            return void(++__s.cycles[__s.recovering ?
+                cpi_stack::RECOVERY : cpi_stack::FRONTEND]);
+        }
+
+        switch(__s.type[__head]) {
+            case cpi_stack::K_LOAD : {
+                bool __store = false; /* Whether a store holds a port. */
+                for(int i = 0 ; i != memory::ports ; ++i)
+                    if(!memory::port[i].idle() && !memory::port[i].load_tag)
+                        __store = true;
+                ++__s.cycles[__store ? cpi_stack::STORE : cpi_stack::LOAD];
+            } break;
+            case cpi_stack::K_ATOMIC : ++__s.cycles[cpi_stack::ATOMIC]; break;
+            default                  : ++__s.cycles[cpi_stack::ALU];
+        }
+    }
+
+    int order[4] = {0,1,2,3}; /* Order of working units in a cycle. */
+
+    /* Work for one unit in a cycle. */
+    template <bool __timed = false>
+    void work_unit(int __n) noexcept {
+        switch(__n) {
+            case 0 : { RISCV_STAGE(FETCH); work_fetch(); } break;
+            case 1 : { RISCV_STAGE(MEMORY); flow.memory_catch(memory::work()); } break;
+            case 2 : { RISCV_STAGE(ROB); flow.reorder_catch(reorder_buffer::work()); } break;
+            case 3 : { RISCV_STAGE(RS); flow.reservation_catch(reservation_station::work()); } break;
+        }
     }
 
     /* Work in one cycle. */
     bool work() noexcept {
-        static std::function <void()> func[] = {
-            [&]() {work_fetch();},
-            [&]() {flow.memory_catch(memory::work());},
-            [&]() {flow.reorder_catch(reorder_buffer::work());},
-            [&]() {flow.reservation_catch(reservation_station::work());},
-        };
-        static int order[4] = {0,1,2,3};
+#ifdef RISCV_STAGE_TIMING
+        if(timing.next_cycle()) return work_cycle <true> ();
+#endif
+        return work_cycle();
+    }
+
+    /* Work in one cycle. (__timed: whether to time the stages) */
+    template <bool __timed = false>
+    bool work_cycle() noexcept {
         // static std::random_device abelcat;
         ++clock;
+        RISCV_STAGE(CYCLE);
 
 
         // std::shuffle(order,order + array_length(order),abelcat);
         for(size_t i = 0 ; i != array_length(order) ; ++i)
-            std::swap(order[i],order[i % array_length(order)]);
-
-        for(size_t i = 0 ; i != array_length(order) ; ++i)
-            func[order[i]]();
-
-        // work_fetch();
-        // flow.memory_catch(memory::work());
-        // flow.reorder_catch(reorder_buffer::work());
-        // flow.reservation_catch(reservation_station::work());
+            work_unit <__timed> (order[i]);
+        if(stack) { RISCV_STAGE(ACCOUNT); account(); }
 
         /* Synchronize to simulate hardware. */   
-        global_sync();
+        global_sync <__timed> ();
         return !is_terminal();
     }
 
+    /**
+     * @brief Work for at most __n cycles in a tight loop.
+     * 
+     * @return Count of cycles worked.
+     */
+    size_t run(size_t __n) noexcept {
+        size_t __beg = clock;
+        while(__n-- && work());
+        return clock - __beg;
+    }
+
 };
 
 }
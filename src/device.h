@@ -0,0 +1,96 @@
+#ifndef _RISC_V_DEVICE_H_
+#define _RISC_V_DEVICE_H_
+
+#include "utility.h"
+
+#include <stdio.h>
+
+namespace dark {
+
+
+/**
+ * @brief Memory-mapped console and exit device.
+ * Guest output is collected in a large host buffer
+ * and written to stdout in bulk.
+ *
+ * Register layout (offset from device_base):
+ * 0x0 putchar : store a byte to print it.
+ * 0x4 putint  : store a word to print it as signed decimal.
+ * 0x8 exit    : store a word to halt with that exit code.
+ * A byte or half-word store gives the zero-extended value stored.
+ *
+ */
+struct console_device {
+    static constexpr address_type device_base = 0xffff0000;
+    static constexpr address_type device_size = 0x00010000;
+
+    static constexpr address_type kPUTCHAR = 0x0;
+    static constexpr address_type kPUTINT  = 0x4;
+    static constexpr address_type kEXIT    = 0x8;
+
+    static constexpr size_t kBUF = 1 << 16; /* Size of host buffer. */
+
+    char   buffer[kBUF];    /* Host output buffer. */
+    size_t length = 0;      /* Length of data in the buffer. */
+
+    bool       muted     = false;   /* Whether output is dropped. */
+    bool       exited    = false;   /* Whether exit is requested. */
+    word_utype exit_code = 0;       /* Exit code from the guest.  */
+
+    /* Whether the address belongs to the device. */
+    static bool in_range(address_type __pos) noexcept
+    { return __pos - device_base < device_size; }
+
+    /* Write all buffered output to the host. */
+    void flush() noexcept {
+        if(length && !muted) fwrite(buffer,1,length,stdout);
+        length = 0;
+    }
+
+    /* Append one character to the buffer. */
+    void put(char __c) noexcept {
+        if(muted) return;
+        if(length == kBUF) flush();
+        buffer[length++] = __c;
+    }
+
+    /* Append a signed decimal integer to the buffer. */
+    void put_int(word_stype __v) noexcept {
+        char __tmp[12];
+        int  __len = 0;
+        word_utype __u = __v < 0 ? -(word_utype)__v : __v;
+        do __tmp[__len++] = '0' + __u % 10; while(__u /= 10);
+        if(__v < 0) put('-');
+        while(__len--) put(__tmp[__len]);
+    }
+
+    /**
+     * @brief Store to a device register. Only the low __m bytes of __v
+     * are stored, so a narrower store acts on its own value.
+     */
+    void store(address_type __pos,word_utype __v,size_t __m = 4) noexcept {
+        if(__m < 4) __v &= (word_utype(1) << (__m << 3)) - 1;
+        switch(__pos - device_base) {
+            case kPUTCHAR : put(__v);     break;
+            case kPUTINT  : put_int(__v); break;
+            case kEXIT    : exited = true , exit_code = __v; break;
+            default: ; /* Writes to unmapped registers are ignored. */
+        }
+    }
+
+    /* Load from a device register. All registers are write-only. */
+    word_utype load(address_type) const noexcept { return 0; }
+
+    /* Drop all output from now on, including pending output. */
+    void mute() noexcept { muted = true , length = 0; }
+
+    /* Reset the device state. Pending output is flushed first. */
+    void reset() noexcept { flush(); exited = false , exit_code = 0; }
+
+    ~console_device() { flush(); }
+};
+
+
+}
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef _RISC_V_DRAM_H_
+#define _RISC_V_DRAM_H_
+
+#include "utility.h"
+
+#include <vector>
+#include <ostream>
+#include <algorithm>
+
+namespace dark {
+
+/**
+ * @brief DRAM timing behind the memory ports.
+ * Addresses map to rows of kROW bytes, interleaved over channels, then
+ * banks. Each bank keeps one row open: a row hit costs tCAS, an empty
+ * bank tRCD + tCAS, and a row conflict tRP + tRCD + tCAS. Data take
+ * tBURST on the bus of the channel. Every tREFI cycles a channel is
+ * refreshed for tRFC cycles, which closes all its rows.
+ *
+ * Requests wait in a queue; each cycle, each channel issues one of
+ * them by FR-FCFS: the oldest row hit to a ready bank, or else the
+ * oldest request to a ready bank. All times are in core cycles.
+ *
+ */
+struct dram_controller {
+    static constexpr uint32_t kROW = 1024;  /* Bytes in a row. */
+
+    struct timing {
+        uint32_t tCAS   = 6;
+        uint32_t tRCD   = 6;
+        uint32_t tRP    = 6;
+        uint32_t tBURST = 2;
+        uint32_t tREFI  = 3900;
+        uint32_t tRFC   = 60;
+    } t;
+
+    struct request {
+        address_type addr;
+        int          port;      /* Memory port waiting for it. */
+        size_t       arrival;   /* Cycle it came in. */
+    };
+
+    struct bank {
+        uint32_t row   = 0;
+        bool     open  = false;
+        size_t   ready = 0;     /* Cycle it takes the next command. */
+    };
+
+    uint32_t channels = 1;
+    uint32_t banks    = 8;
+    std::vector <bank>    bank_state;
+    std::vector <size_t>  bus_free;     /* Cycle the bus of a channel is free. */
+    std::vector <size_t>  next_refresh;
+    std::vector <request> queue;        /* Requests not issued, oldest first. */
+    size_t now = 0;
+
+    size_t count[4]  = {0,0,0,0};   /* Row hits / empty / conflicts / refreshes. */
+    size_t latency   = 0;           /* Sum of cycles from arrival to data. */
+
+    dram_controller() { configure(channels,banks); }
+
+    /* Set the geometry, with all banks closed. */
+    void configure(uint32_t __channels,uint32_t __banks) {
+        channels = std::max(__channels,1u);
+        banks    = std::max(__banks,1u);
+        bank_state.assign(channels * banks,bank {});
+        bus_free.assign(channels,0);
+        next_refresh.assign(channels,t.tREFI);
+        queue.clear();
+    }
+
+    uint32_t channel_of(address_type __a) const noexcept { return __a / kROW % channels; }
+    uint32_t bank_of(address_type __a) const noexcept
+    { return channel_of(__a) * banks + __a / kROW / channels % banks; }
+    uint32_t row_of(address_type __a) const noexcept { return __a / kROW / channels / banks; }
+
+    /* A memory port asks for the data at __addr. */
+    void push(address_type __addr,int __port) { queue.push_back({__addr,__port,now}); }
+
+    /* Drop the request of a port, if not issued. */
+    void cancel(int __port) noexcept {
+        for(size_t i = 0 ; i != queue.size() ; ++i)
+            if(queue[i].port == __port) return void(queue.erase(queue.begin() + i));
+    }
+
+    /* Drop all requests not issued. */
+    void clear() noexcept { queue.clear(); }
+
+    /**
+     * @brief Work for one cycle: refresh, then issue by FR-FCFS.
+     *
+     * @param __done Called as __done(port,cycles) for each request
+     * issued, with the cycles from now until its data is there.
+     */
+    template <class F>
+    void tick(F &&__done) {
+        ++now;
+        for(uint32_t c = 0 ; c != channels ; ++c) {
+            if(now >= next_refresh[c]) {
+                next_refresh[c] += t.tREFI , ++count[3];
+                for(uint32_t b = 0 ; b != banks ; ++b) {
+                    auto &__b = bank_state[c * banks + b];
+                    __b.open  = false;
+                    __b.ready = std::max(__b.ready,now + t.tRFC);
+                }
+            }
+            if(queue.empty()) continue;
+
+            int __pick = -1;
+            for(size_t i = 0 ; i != queue.size() ; ++i) {
+                auto __a = queue[i].addr;
+                auto &__b = bank_state[bank_of(__a)];
+                if(channel_of(__a) != c || __b.ready > now) continue;
+                if(__b.open && __b.row == row_of(__a)) { __pick = i; break; }
+                if(__pick < 0) __pick = i;
+            }
+            if(__pick >= 0) __done(queue[__pick].port,issue(queue[__pick])) ,
+                            queue.erase(queue.begin() + __pick);
+        }
+    }
+
+    /* Average cycles from arrival to data. */
+    double average_latency() const noexcept {
+        size_t __n = count[0] + count[1] + count[2];
+        return __n ? double(latency) / __n : 0;
+    }
+
+    /* Print the row buffer and latency statistics. */
+    void print(std::ostream &__os) const {
+        __os << "DRAM: " << count[0] << " row hits, " << count[1]
+             << " empty, " << count[2] << " conflicts, " << count[3]
+             << " refreshes, average latency " << average_latency() << '\n';
+    }
+
+  private:
+
+    /* Issue a request to its ready bank: return cycles until data. */
+    size_t issue(const request &__r) noexcept {
+        auto &__b = bank_state[bank_of(__r.addr)];
+        uint32_t __row = row_of(__r.addr);
+        size_t __lat = t.tCAS;
+        if(!__b.open)            __lat += t.tRCD , ++count[1];
+        else if(__b.row != __row) __lat += t.tRP + t.tRCD , ++count[2];
+        else ++count[0];
+
+        auto &__bus = bus_free[channel_of(__r.addr)];
+        size_t __data = std::max(now + __lat,__bus) + t.tBURST;
+        __bus    = __data;
+        __b.open = true , __b.row = __row;
+        __b.ready = now + __lat - t.tCAS + t.tBURST;
+        latency += __data - __r.arrival;
+        return __data - now;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef _RISC_V_ELIMINATION_H_
+#define _RISC_V_ELIMINATION_H_
+
+#include "alu.h"
+#include "utility.h"
+#include "instruction.h"
+
+namespace dark {
+
+/**
+ * @brief Commands resolved at rename, which never enter the RS.
+ * They go into RoB done, as lui does.
+ *
+ *  Write to x0  : add x0,.. / addi x0,.. etc. do nothing.
+ *  Constant     : all sources x0 (li rd,imm), or a zero idiom
+ *                 (xor/sub/slt/sltu rd,rs,rs, andi rd,rs,0 ...).
+ *                 The value is written to the new register at issue.
+ *  Move         : mv rd,rs (addi rd,rs,0), add/or/xor rd,rs,x0,
+ *                 and/or rd,rs,rs, shift by 0. rd shares the physical
+ *                 register of rs, which is freed after both are.
+ *
+ */
+struct rename_elimination {
+    enum : byte_utype { NONE, DISCARD, CONSTANT, MOVE };
+
+    byte_utype elim[32] = {};           /* Kind, by RoB index. */
+    bool   elim_enable   = false;       /* Whether to eliminate. */
+    size_t elim_count[3] = {0,0,0};     /* Commited: x0 / constant / move. */
+
+    /**
+     * @brief Kind of __a when eliminated. (NONE if not)
+     *
+     * @param __src Source register of a move.
+     * @param __val Value of a constant.
+     */
+    static byte_utype eliminable(instruction __a,word_utype &__src,
+                                 register_type &__val) noexcept {
+        bool __imm = __a.suc == suc_code::icode;
+        if(!__imm && __a.suc != suc_code::rcode) return NONE;
+        if(!__a.rd) return DISCARD;
+
+        ALU_code __code = (ALU_code)__a.mid;
+        bool __shift = __a.mid == 1 || __a.mid == 5;
+        if(__code == ALU_code::SRL && __a.pre) __code = ALU_code::SRA;
+        if(__code == ALU_code::ADD && __a.pre && !__imm) __code = ALU_code::SUB;
+
+        /* Value of the second source, if known. */
+        word_utype __rs1 = __a.rs1;
+        word_utype __rs2 = __imm ? 0 : __a.rs2;
+        register_type __rhs = !__imm ? 0 :
+            (__shift ? register_type(__a.rs2) : register_type(__a.I_immediate()));
+        bool __known = __imm || !__rs2;
+
+        if(!__rs1 && __known)
+            return __val = ALU_type::work(0,__rhs,__code) , CONSTANT;
+
+        if(!__imm && __rs1 == __rs2) switch(__code) {
+            case ALU_code::XOR : case ALU_code::SUB :
+            case ALU_code::LT  : case ALU_code::LTU :
+                return __val = 0 , CONSTANT;
+            case ALU_code::AND : case ALU_code::OR  :
+                return __src = __rs1 , MOVE;
+            default: return NONE;
+        }
+
+        if(__known && !__rhs) switch(__code) {
+            case ALU_code::AND : case ALU_code::LTU :
+                return __val = 0 , CONSTANT;
+            case ALU_code::LT  : return NONE;
+            default: return __src = __rs1 , MOVE;
+        }
+
+        /* rs1 is x0 and rs2 is a register. */
+        if(!__rs1) switch(__code) {
+            case ALU_code::ADD : case ALU_code::XOR : case ALU_code::OR :
+                return __src = __rs2 , MOVE;
+            case ALU_code::AND : case ALU_code::ALL :
+            case ALU_code::SRL : case ALU_code::SRA :
+                return __val = 0 , CONSTANT;
+            default: return NONE;
+        }
+        return NONE;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef _RISC_V_FETCH_QUEUE_H_
+#define _RISC_V_FETCH_QUEUE_H_
+
+#include "utility.h"
+#include "instruction.h"
+#include "round_queue.h"
+
+namespace dark {
+
+/**
+ * @brief Decoupled front end. A prediction stage runs ahead of fetch:
+ * it reads the commands ahead (as predecode would) up to the end of
+ * a block, predicts where the block goes, and puts the block into the
+ * fetch target queue (FTQ). Fetch takes up to kWIDTH slots a cycle from
+ * the FTQ into the instruction buffer (IB), which issue reads from.
+ * Fetch goes on while issue is blocked, until the IB is full.
+ *
+ * A block ends at a branch or jal, after kBLOCK commands, or at a jalr
+ * (or the terminal command), where prediction stops till redirected.
+ *
+ */
+struct fetch_queue {
+    static constexpr uint32_t kFTQ   = 4;   /* Blocks in the FTQ. */
+    static constexpr uint32_t kBLOCK = 4;   /* Commands in a block. */
+    static constexpr uint32_t kWIDTH = 2;   /* Slots fetched in a cycle. */
+    static constexpr uint32_t kIB    = 16;  /* Max depth of the IB. */
+
+    /* One block to fetch. */
+    struct fetch_target {
+        address_type pc;        /* PC of the first command. */
+        byte_utype   size;      /* Commands in the block. */
+        bool         prediction;/* Prediction of the branch ending it. */
+        byte_utype   predict;   /* Index of the prediction. */
+    };
+
+    /* One command (or fused pair) fetched. */
+    struct fetch_slot {
+        instruction  cmd;       /* The command. */
+        instruction  second;    /* Second command of a pair. */
+        address_type pc;        /* PC of the command. */
+        size_t       fetched;   /* Cycle fetched. */
+        byte_utype   fusion;    /* Kind of the pair. (0 if none) */
+        bool         prediction;/* Prediction if a branch. */
+        byte_utype   predict;   /* Index of the prediction. */
+    };
+
+    round_queue <fetch_target,kFTQ> ftq;
+    round_queue <fetch_slot,kIB>     ib;
+    fetch_slot ib_new[kWIDTH];  /* Slots fetched in this cycle. */
+    uint32_t   ib_count  = 0;   /* Count of slots fetched in this cycle. */
+    uint32_t   fq_offset = 0;   /* Commands of the FTQ head fetched. */
+    uint32_t   fq_depth  = 8;   /* Depth of the IB in use. */
+    bool       fq_stop   = false;   /* Prediction stopped till redirect. */
+    bool       fq_enable = false;   /* Whether to use the front end. */
+    size_t     fq_count[3] = {0,0,0};
+    /* Cycles issue found the IB empty / cycles fetch went on while
+       issue was blocked / sum of IB occupancy over cycles. */
+
+    /* Drop all the blocks and slots: the front end restarts. */
+    void fq_flush() noexcept {
+        ftq.clear() , ib.clear();
+        ib_count = fq_offset = 0;
+        fq_stop  = false;
+    }
+
+    /* PC of the oldest command not issued, or __pc if none. */
+    address_type fq_oldest(address_type __pc) const noexcept {
+        if(!ib.empty())  return ib.front().pc;
+        if(!ftq.empty()) return ftq.front().pc + 4 * fq_offset;
+        return __pc;
+    }
+
+    /* Move the slots fetched in this cycle into the IB. */
+    void fq_sync() noexcept {
+        for(uint32_t i = 0 ; i != ib_count ; ++i) ib.push(ib_new[i]);
+        ib_count = 0;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef _RISC_V_FUNCTIONAL_H_
+#define _RISC_V_FUNCTIONAL_H_
+
+#include "alu.h"
+#include "memio.h"
+#include "register.h"
+#include "predictor.h"
+#include "instruction.h"
+
+namespace dark {
+
+/**
+ * @brief Functional (untimed) execution of commands.
+ * It works on the architectural state of a drained
+ * pipeline and trains the predictor on the way.
+ * 
+ */
+struct functional_unit {
+    /**
+     * @brief Execute the command at pc.
+     * 
+     * @return Whether the program may go on. False on the terminal
+     * command (left unexecuted), exit device or unknown command.
+     */
+    static bool work(memory &__mem,register_file &__reg,
+                     predictor &__pred) noexcept {
+        instruction __inst {0};
+        __mem.fetch(__inst.command);
+        if(__inst.command == 0x0ff00513) return false;
+
+        address_type  __pc  = __mem.pc;
+        address_type  __nxt = __pc + 4;
+        register_type __val = 0;
+        bool        __write = true;
+        ALU_code     __code = (ALU_code)__inst.mid;
+
+        switch(__inst.suc) {
+            case suc_code::lui   : __val = __inst.U_immediate();        break;
+            case suc_code::auipc : __val = __inst.U_immediate() + __pc; break;
+
+            case suc_code::jal   :
+                __val = __pc + 4;
+                __nxt = __pc + __inst.J_immediate();
+                break;
+
+            case suc_code::jalr  :
+                __val = __pc + 4;
+                __nxt = (__reg.arch(__inst.rs1) + __inst.I_immediate()) & ~1;
+                break;
+
+            case suc_code::bcode : {
+                bool __jump = ALU_type::work(__reg.arch(__inst.rs1),
+                                             __reg.arch(__inst.rs2),
+                                             B_ALU_map[__inst.mid]);
+                __pred.warm(__pc,__jump);
+                if(__jump) __nxt = __pc + __inst.B_immediate();
+                __write = false;
+            } break;
+
+            case suc_code::lcode :
+                __val = __mem.load_extend(__inst.mid,
+                                          __reg.arch(__inst.rs1) + __inst.I_immediate());
+                break;
+
+            case suc_code::scode :
+                __mem.write(__reg.arch(__inst.rs1) + __inst.S_immediate(),
+                            __reg.arch(__inst.rs2),1 << (__inst.mid & 0b11));
+                __write = false;
+                break;
+
+            case suc_code::icode :
+                if(__code == ALU_code::SRL && __inst.pre)
+                    __code = ALU_code::SRA , __inst.pre = 0;
+                __val = ALU_type::work(__reg.arch(__inst.rs1),__inst.I_immediate(),__code);
+                break;
+
+            case suc_code::rcode :
+                if(__code == ALU_code::SRL && __inst.pre)
+                    __code = ALU_code::SRA;
+                if(__code == ALU_code::ADD && __inst.pre)
+                    __code = ALU_code::SUB;
+                __val = ALU_type::work(__reg.arch(__inst.rs1),__reg.arch(__inst.rs2),__code);
+                break;
+
+            case suc_code::acode :
+                __val = __mem.atomic(AMO_code(__inst.pre >> 2),
+                                     __reg.arch(__inst.rs1),__reg.arch(__inst.rs2));
+                break;
+
+            case suc_code::fence : __write = false; break;
+
+            case suc_code::scall :
+                if(__inst.mid == 0) return false;
+                if(__inst.I_imm_11_00 == CSR_MHARTID) __val = __reg.hartid;
+                break;
+
+            default: return false; /* Unknown command. */
+        }
+
+        if(__write) __reg.write_arch(__inst.rd,__val);
+        __mem.pc = __nxt;
+        return !__mem.is_exit();
+    }
+};
+
+}
+
+#endif
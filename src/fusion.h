@@ -0,0 +1,81 @@
+#ifndef _RISC_V_FUSION_H_
+#define _RISC_V_FUSION_H_
+
+#include "utility.h"
+#include "instruction.h"
+
+namespace dark {
+
+/**
+ * @brief Macro-op fusion of two adjacent commands into one RoB entry.
+ * Pairs are found at fetch, which then takes both commands in one
+ * cycle. The first result is written by its own rename when the
+ * second does not overwrite it, and commited with the pair.
+ *
+ *  lui   rd,hi  + addi rd2,rd,lo     : constant known at issue.
+ *  auipc rd,hi  + addi rd2,rd,lo     : address known at issue.
+ *  auipc rd,hi  + jalr rd2,lo(rd)    : far jump, target known at fetch.
+ *  slli  rd,rs,1..3 + add rd,rd,rs2  : one shift-add in the RS.
+ *  slt/sltu/slti/sltiu rd + beq/bne rd,x0 : compare and branch.
+ *
+ */
+struct macro_fusion {
+    enum : byte_utype {
+        NONE,
+        LUI_ADDI,
+        AUIPC_ADDI,
+        AUIPC_JALR,
+        SHIFT_ADD,
+        CMP_BRANCH
+    };
+
+    /* First command of a pair in RoB, by RoB index of the pair. */
+    struct slot {
+        byte_utype dest;    /* Destination of the first. (0 if none) */
+        byte_utype phys;    /* Physical register of it. */
+        byte_utype old;     /* Physical register to free at commit. */
+        bool       pair;    /* Whether the entry is a pair. */
+        bool     invert;    /* Whether dest is the opposite of the branch. */
+    } fused[32] = {};
+
+    bool   fusion_enable = false;   /* Whether to fuse pairs. */
+    size_t fusion_count  = 0;       /* Pairs commited. */
+
+    /* Kind of the pair of __a followed by __b. (NONE if not fusible) */
+    static byte_utype fusible(instruction __a,instruction __b) noexcept {
+        if(!__a.rd) return NONE;
+        bool __addi = __b.suc == suc_code::icode && __b.mid == 0 && __b.rs1 == __a.rd;
+        switch(__a.suc) {
+            case suc_code::lui   : return __addi ? LUI_ADDI : NONE;
+            case suc_code::auipc :
+                if(__addi) return AUIPC_ADDI;
+                if(__b.suc == suc_code::jalr && __b.rs1 == __a.rd) return AUIPC_JALR;
+                return NONE;
+
+            case suc_code::icode :
+                if(__a.mid == 1 && __a.pre == 0 && __a.rs2 - 1u < 3 &&
+                   __b.suc == suc_code::rcode && __b.mid == 0 && __b.pre == 0 &&
+                   __b.rd == __a.rd && (__b.rs1 == __a.rd) != (__b.rs2 == __a.rd))
+                    return SHIFT_ADD;
+                [[fallthrough]];    /* slti/sltiu as below. */
+            case suc_code::rcode :
+                if(__a.suc == suc_code::rcode && __a.pre) return NONE;
+                if(__a.mid != 2 && __a.mid != 3) return NONE;
+                if(__b.suc != suc_code::bcode || __b.mid > 1) return NONE;
+                if((__b.rs1 == __a.rd && __b.rs2 == 0) ||
+                   (__b.rs2 == __a.rd && __b.rs1 == 0)) return CMP_BRANCH;
+                return NONE;
+            default: return NONE;
+        }
+    }
+
+    /* Whether __a may start a pair, to save fetching the next. */
+    static bool may_lead(instruction __a) noexcept {
+        return __a.suc == suc_code::lui   || __a.suc == suc_code::auipc
+            || __a.suc == suc_code::icode || __a.suc == suc_code::rcode;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef _RISC_V_INTERVAL_H_
+#define _RISC_V_INTERVAL_H_
+
+#include "cpu.h"
+#include "functional.h"
+
+#include <memory>
+#include <thread>
+
+namespace dark {
+
+/**
+ * @brief Parallel interval simulation.
+ * A functional pass splits the program into intervals of equal
+ * command count and captures the architectural state (with the
+ * functionally warmed predictor) a little before each boundary.
+ * Every interval is then simulated in detail on its own host thread
+ * with its own cpu, and the cycles of all intervals are added up.
+ * 
+ */
+struct interval_simulator {
+    size_t intervals = 4;       /* Count of intervals. */
+    size_t warmup    = 10000;   /* Detailed commands before each interval. */
+
+    size_t instructions = 0;        /* Total commited commands. */
+    std::vector <size_t> bound;     /* First command of each interval. */
+    std::vector <size_t> cycles;    /* Cycles of each interval. */
+
+    /**
+     * @brief Simulate one interval in detail.
+     * 
+     * @param __skip Commands of warm-up before the interval.
+     * @param __stop Commands until the end of the interval.
+     * @param __last Whether to run until the program ends.
+     * @return Cycles spent in the interval.
+     */
+    static size_t simulate(cpu &__c,size_t __skip,
+                           size_t __stop,bool __last) noexcept {
+        bool __live = true;
+        while(__live && __c.instructions() < __skip) __live = __c.work();
+        size_t __clk = __c.clock;
+        while(__live && (__last || __c.instructions() < __stop))
+            __live = __c.work();
+        return __c.clock - __clk;
+    }
+
+    /**
+     * @brief Run the program. __c is left in its final
+     * architectural state by the functional pass.
+     */
+    void run(cpu &__c) {
+        auto __copy = std::make_unique <cpu> (__c);
+        __copy->console.mute();
+        __copy->trace = nullptr;  /* Copies are not traced. */
+        __copy->stack = nullptr;
+        __copy->profile = nullptr;
+
+        /* Functional pass: count all the commands. */
+        instructions = 0;
+        while(functional_unit::work(__c,__c,__c)) ++instructions;
+
+        size_t __k = intervals ? intervals : 1;
+        bound.resize(__k + 1);
+        for(size_t i = 0 ; i <= __k ; ++i) bound[i] = instructions * i / __k;
+
+        /* Capture the state at the start of each warm-up. */
+        std::vector <std::unique_ptr <cpu>> __state(__k);
+        std::vector <size_t> __start(__k);
+        size_t __pos = 0;
+        for(size_t i = 0 ; i != __k ; ++i) {
+            __start[i] = bound[i] > warmup ? bound[i] - warmup : 0;
+            while(__pos < __start[i]) functional_unit::work(*__copy,*__copy,*__copy) , ++__pos;
+            __state[i] = std::make_unique <cpu> (*__copy);
+        }
+
+        /* Detailed simulation of all intervals in parallel. */
+        cycles.assign(__k,0);
+        std::vector <std::thread> __pool;
+        for(size_t i = 0 ; i != __k ; ++i) {
+            __pool.emplace_back([&,i]() {
+                cycles[i] = simulate(*__state[i],
+                                     bound[i]     - __start[i],
+                                     bound[i + 1] - __start[i],
+                                     i + 1 == __k);
+            });
+        } for(auto &__t : __pool) __t.join();
+    }
+
+    /* Total cycles of all intervals. */
+    size_t total() const noexcept {
+        size_t __sum = 0;
+        for(auto __c : cycles) __sum += __c;
+        return __sum;
+    }
+
+    /* Print the result of each interval. */
+    void print(std::ostream &__os) const {
+        for(size_t i = 0 ; i != cycles.size() ; ++i)
+            __os << "Interval " << i << ": commands " << bound[i]
+                 << " ~ " << bound[i + 1] << ", cycles " << cycles[i] << '\n';
+        __os << "Instructions: " << instructions << '\n'
+             << "Total cycles: " << total() << '\n';
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,251 @@
+#ifndef _RISC_V_LOCKSTEP_H_
+#define _RISC_V_LOCKSTEP_H_
+
+#include "alu.h"
+#include "memio.h"
+#include "instruction.h"
+
+#include <memory>
+
+namespace dark {
+
+/**
+ * @brief ALU working on all lanes at once, with the same semantics
+ * as arithetic_logic_unit. __v is a GCC vector of word_utype, which
+ * is compiled into SSE/AVX2/AVX-512 as the target allows.
+ * Comparisons give 1 or 0 in each lane.
+ *
+ */
+template <class __v,class __s>
+struct vector_logic_unit {
+    /* Vectors are passed by reference, to keep the ABI of any target. */
+    static void work (__v &__res,const __v &__reg1,const __v &__reg2,
+                      ALU_code __code) noexcept {
+        switch(__code) {
+            case ALU_code::ADD : __res = __reg1  + __reg2; break;
+            case ALU_code::SUB : __res = __reg1  - __reg2; break;
+            case ALU_code::ALL : __res = __reg1 << (__reg2 & 31); break;
+            case ALU_code::SRL : __res = __reg1 >> (__reg2 & 31); break;
+            case ALU_code::SRA : __res = (__v)((__s)__reg1 >> (__s)(__reg2 & 31)); break;
+            case ALU_code::LT  : __res = (__v)((__s)__reg1 <  (__s)__reg2) & 1; break;
+            case ALU_code::LTU : __res = (__v)(__reg1 <  __reg2) & 1; break;
+            case ALU_code::GE  : __res = (__v)((__s)__reg1 >= (__s)__reg2) & 1; break;
+            case ALU_code::GEU : __res = (__v)(__reg1 >= __reg2) & 1; break;
+            case ALU_code::EQ  : __res = (__v)(__reg1 == __reg2) & 1; break;
+            case ALU_code::NE  : __res = (__v)(__reg1 != __reg2) & 1; break;
+            case ALU_code::XOR : __res = __reg1  ^ __reg2; break;
+            case ALU_code::OR  : __res = __reg1  | __reg2; break;
+            case ALU_code::AND : __res = __reg1  & __reg2; break;
+            default: __res = __reg1 ^ __reg1; /* This should never happen. */
+        }
+    }
+};
+
+/* GCC vectors of __n lanes. (8 fill AVX2, 16 fill AVX-512) */
+template <size_t __n> struct lane_vector;
+template <> struct lane_vector  <8> {
+    typedef word_utype type __attribute__((vector_size(32)));
+    typedef word_stype sign __attribute__((vector_size(32)));
+};
+template <> struct lane_vector <16> {
+    typedef word_utype type __attribute__((vector_size(64)));
+    typedef word_stype sign __attribute__((vector_size(64)));
+};
+
+/**
+ * @brief Functional execution of __n independent programs in SIMD
+ * lanes, for batch runs where only the exit value matters.
+ * Registers are kept in SoA form, one vector for each register.
+ * Lanes at the same PC with the same command run it together
+ * under a mask; the lowest PC goes first, so diverged lanes
+ * meet again at the join point. Memory is scalar, one per lane.
+ *
+ */
+template <size_t __n>
+struct lockstep_unit {
+    using lane_type = typename lane_vector <__n>::type;
+    using sign_type = typename lane_vector <__n>::sign;
+    using VALU_type = vector_logic_unit <lane_type,sign_type>;
+
+    lane_type reg[32];  /* reg[i][k] : Register i of lane k. */
+    lane_type pc;       /* PC of each lane. */
+    lane_type lane_bit; /* Bit k in lane k. */
+    std::unique_ptr <memory[]> mem = std::make_unique <memory[]> (__n);
+
+    word_utype live = 0;        /* Lanes still running. */
+    size_t     steps    = 0;    /* Commands run, as a vector. */
+    size_t     commands = 0;    /* Commands run, in all lanes. */
+
+    lockstep_unit() noexcept {
+        for(size_t k = 0 ; k != __n ; ++k) lane_bit[k] = 1u << k;
+        clear_lanes();
+    }
+
+    /* Load the program image of lane __k in hex text format. */
+    void load(size_t __k,const char *__str,size_t __len) noexcept {
+        mem[__k].init(__str,__len);
+        live |= 1u << __k;
+    }
+
+    /* Start over with empty memory in all lanes. */
+    void reset() noexcept {
+        for(size_t k = 0 ; k != __n ; ++k) mem[k].reset();
+        clear_lanes();
+        live = 0;
+    }
+
+    /* Run until all lanes end. */
+    void run() noexcept { while(work()); }
+
+    /**
+     * @brief Run the command at the lowest PC in all lanes there.
+     *
+     * @return Whether any lane is still running.
+     */
+    bool work() noexcept {
+        if(!live) return false;
+
+        /* Pick the lowest PC, then the lanes with the same command. */
+        lane_type __live = (lane_type)((lane_bit & live) != 0);
+        lane_type __pcs  = __live != 0 ? pc : __live ^ __live;
+        address_type __pc = ~address_type(0);
+        for(size_t k = 0 ; k != __n ; ++k)
+            if(__pcs[k] <= __pc && __live[k]) __pc = __pcs[k];
+        lane_type __at = (lane_type)(pc == __pc) & __live & lane_bit;
+
+        instruction __inst;
+        word_utype  __bits = 0;
+        for(size_t k = 0 ; k != __n ; ++k) {
+            if(!__at[k]) continue;
+            command_type __cmd = 0;
+            mem[k].memory_chip::load(__pc,__cmd,4);
+            if(!__bits) __inst.command = __cmd;
+            if(__cmd == __inst.command) __bits |= __at[k];
+        }
+
+        ++steps , commands += __builtin_popcount(__bits);
+        if(!execute(__inst,__bits)) return end(__bits) , live;
+
+        /* Lanes stopped by the exit device. */
+        if(__inst.suc == suc_code::scode || __inst.suc == suc_code::acode)
+            for(size_t k = 0 ; k != __n ; ++k)
+                if(__bits >> k & 1 && mem[k].is_exit()) end(1u << k);
+        return live;
+    }
+
+    /* Exit code of lane __k: from exit device if used, or lowest byte of a0. */
+    word_utype exit_code(size_t __k) const noexcept {
+        return mem[__k].is_exit() ? mem[__k].console.exit_code
+                                  : (uint8_t)reg[10][__k];
+    }
+
+    /* Average count of lanes working in a step. */
+    double utilization() const noexcept
+    { return steps ? double(commands) / steps : 0; }
+
+  private:
+
+    /* Zero all registers and PC. */
+    void clear_lanes() noexcept {
+        for(auto &__r : reg) __r = __r ^ __r;
+        pc = pc ^ pc;
+    }
+
+    /* Lanes in __bits end: flush their output in lane order. */
+    void end(word_utype __bits) noexcept {
+        live &= ~__bits;
+        for(size_t k = 0 ; k != __n ; ++k)
+            if(__bits >> k & 1) mem[k].console.flush();
+    }
+
+    /**
+     * @brief Execute one command in the lanes of __bits.
+     *
+     * @return Whether these lanes may go on. False on the terminal
+     * command (left unexecuted), ecall or unknown command.
+     */
+    bool execute(instruction __inst,word_utype __bits) noexcept {
+        if(__inst.command == 0x0ff00513) return false;
+
+        lane_type __m   = (lane_type)((lane_bit & __bits) != 0);
+        lane_type __nxt = pc + 4;
+        lane_type __val = pc ^ pc;
+        bool    __write = true;
+        ALU_code __code = (ALU_code)__inst.mid;
+
+        const lane_type &__rs1 = reg[__inst.rs1];
+        const lane_type &__rs2 = reg[__inst.rs2];
+
+        switch(__inst.suc) {
+            case suc_code::lui   : __val += __inst.U_immediate();           break;
+            case suc_code::auipc : __val = pc + __inst.U_immediate();        break;
+
+            case suc_code::jal   :
+                __val = pc + 4;
+                __nxt = pc + __inst.J_immediate();
+                break;
+
+            case suc_code::jalr  :
+                __val = pc + 4;
+                __nxt = (__rs1 + __inst.I_immediate()) & ~1u;
+                break;
+
+            case suc_code::bcode : {
+                lane_type __jump;
+                VALU_type::work(__jump,__rs1,__rs2,B_ALU_map[__inst.mid]);
+                __nxt = __jump != 0 ? pc + __inst.B_immediate() : __nxt;
+                __write = false;
+            } break;
+
+            case suc_code::lcode : {
+                lane_type __addr = __rs1 + __inst.I_immediate();
+                for(size_t k = 0 ; k != __n ; ++k)
+                    if(__bits >> k & 1) __val[k] = mem[k].load_extend(__inst.mid,__addr[k]);
+            } break;
+
+            case suc_code::scode : {
+                lane_type __addr = __rs1 + __inst.S_immediate();
+                for(size_t k = 0 ; k != __n ; ++k)
+                    if(__bits >> k & 1)
+                        mem[k].write(__addr[k],__rs2[k],1 << (__inst.mid & 0b11));
+                __write = false;
+            } break;
+
+            case suc_code::icode :
+                if(__code == ALU_code::SRL && __inst.pre)
+                    __code = ALU_code::SRA;
+                VALU_type::work(__val,__rs1,__val + __inst.I_immediate(),__code);
+                break;
+
+            case suc_code::rcode :
+                if(__code == ALU_code::SRL && __inst.pre)
+                    __code = ALU_code::SRA;
+                if(__code == ALU_code::ADD && __inst.pre)
+                    __code = ALU_code::SUB;
+                VALU_type::work(__val,__rs1,__rs2,__code);
+                break;
+
+            case suc_code::acode :
+                for(size_t k = 0 ; k != __n ; ++k)
+                    if(__bits >> k & 1)
+                        __val[k] = mem[k].atomic(AMO_code(__inst.pre >> 2),__rs1[k],__rs2[k]);
+                break;
+
+            case suc_code::fence : __write = false; break;
+
+            case suc_code::scall :
+                if(__inst.mid == 0) return false;
+                break; /* mhartid and others read as 0. */
+
+            default: return false; /* Unknown command. */
+        }
+
+        if(__write && __inst.rd) reg[__inst.rd] = __m != 0 ? __val : reg[__inst.rd];
+        pc = __m != 0 ? __nxt : pc;
+        return true;
+    }
+};
+
+}
+
+#endif
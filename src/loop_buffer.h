@@ -0,0 +1,80 @@
+#ifndef _RISC_V_LOOP_BUFFER_H_
+#define _RISC_V_LOOP_BUFFER_H_
+
+#include "utility.h"
+#include "instruction.h"
+
+namespace dark {
+
+/**
+ * @brief Loop stream buffer in front of fetch.
+ * A backward branch over at most kSIZE commands starts a capture of
+ * the loop body from its target. Once the body is fetched through to
+ * the branch without any other jump, the loop is replayed from the
+ * buffer for as long as PC stays inside it, without touching memory.
+ *
+ */
+struct loop_buffer {
+    static constexpr uint32_t kSIZE = 16; /* Commands in the buffer. */
+
+    enum : byte_utype { IDLE, CAPTURE, REPLAY };
+
+    command_type  loop_body[kSIZE]; /* Commands of the loop. */
+    address_type  loop_head = 0;    /* Target of the backward branch. */
+    address_type  loop_tail = 0;    /* PC of the backward branch. */
+    address_type  loop_next = 0;    /* PC expected next in capture. */
+    byte_utype    loop_state  = IDLE;
+    bool          loop_enable = false;  /* Whether to use the buffer. */
+    size_t        loop_count[2] = {0,0};/* Fetches / fetches from buffer. */
+
+    /**
+     * @brief Fetch the command at __pc from the buffer, if replaying it.
+     * Only used when loop_enable is set.
+     *
+     * @return Whether __cmd is taken from the buffer.
+     */
+    bool loop_fetch(address_type __pc,command_type &__cmd) noexcept {
+        ++loop_count[0];
+        if(loop_state != REPLAY) return false;
+        if(__pc - loop_head > loop_tail - loop_head)
+            return loop_state = IDLE , false;
+        __cmd = loop_body[(__pc - loop_head) >> 2];
+        return ++loop_count[1] , true;
+    }
+
+    /* Watch a command fetched from memory, to capture loops. */
+    void loop_watch(address_type __pc,command_type __cmd) noexcept {
+        instruction __inst = {__cmd};
+        if(loop_state == CAPTURE) {
+            if(__pc == loop_next) {
+                loop_body[(__pc - loop_head) >> 2] = __cmd;
+                if(__pc == loop_tail) return void(loop_state = REPLAY);
+                loop_next += 4;
+                if(__inst.suc != suc_code::jal && __inst.suc != suc_code::jalr)
+                    return;
+            } loop_state = IDLE; /* Left the loop: try this command. */
+        }
+
+        if(__inst.suc != suc_code::bcode) return;
+        word_stype __imm = __inst.B_immediate();
+        if(__imm >= 0 || address_type(-__imm) >= kSIZE * 4) return;
+        loop_head  = __pc + __imm;
+        loop_tail  = __pc;
+        loop_next  = loop_head;
+        loop_state = CAPTURE;
+    }
+
+    /* Drop the loop if a store hits it. */
+    void loop_invalidate(address_type __pos,size_t __m) noexcept {
+        if(loop_state != IDLE && __pos < loop_tail + 4 && loop_head < __pos + __m)
+            loop_state = IDLE;
+    }
+
+    /* Ratio of fetches served by the buffer. */
+    double loop_coverage() const noexcept
+    { return loop_count[0] ? double(loop_count[1]) / loop_count[0] : 0; }
+};
+
+}
+
+#endif
@@ -3,12 +3,32 @@
 
 #include "utility.h"
 
+#include <algorithm>
+
 namespace dark {
 
 
 template <size_t __n>
 struct memory_chip {
+    static constexpr size_t kPAGE = 4096; /* Size of a page. */
+
     char data[__n]; /* The real internal data. */
+    std::bitset <(__n + kPAGE - 1) / kPAGE> dirty; /* Pages written. */
+
+    /* Mark pages in [__pos,__pos + __m) as written. */
+    void mark(address_type __pos,size_t __m) noexcept {
+        if(!__m) return;
+        for(size_t i = __pos / kPAGE ; i <= (__pos + __m - 1) / kPAGE ; ++i)
+            dirty[i] = true;
+    }
+
+    /* Zero all the written pages only. */
+    void clear() noexcept {
+        for(auto i  = dirty._Find_first() ;
+                 i != dirty.size() ; i = dirty._Find_next(i))
+            memset(data + i * kPAGE,0,std::min(kPAGE,__n - i * kPAGE));
+        dirty.reset();
+    }
 
     /* Load a trivial type from memory. */
     template <class T>
@@ -22,18 +42,35 @@ struct memory_chip {
     void store(address_type __pos,const T &__v,size_t __m) noexcept {
         if(__pos + __m > __n) return;
         memcpy(data + __pos,&__v,__m);
+        dirty[__pos / kPAGE] = dirty[(__pos + __m - 1) / kPAGE] = true;
     }
 
     /* Initial program data into memory from stdin. */
-    void init() noexcept {
+    void init() noexcept { init([]() { return getchar(); }); }
+
+    /* Initial program data into memory from a text buffer. */
+    void init(const char *__str,size_t __len) noexcept {
+        const char *__end = __str + __len;
+        init([&]() { return __str == __end ? EOF : (unsigned char)*__str++; });
+    }
+
+    /**
+     * @brief Initial program data into memory in hex text format.
+     * 
+     * @param __get Return next char, or EOF at the end.
+     */
+    template <class F>
+    void init(F &&__get) noexcept {
         char buffer[32];
         address_type __a = 0;
-        while(read_token(buffer)) {
+        while(read_token(buffer,__get)) {
             if(buffer[0] == '@') {
                 __a = hex_to_integer <address_type> (buffer + 1);
             } else {
-                data[__a++] = char_map(buffer[0]) << 4 |
-                              char_map(buffer[1]);
+                if(__a < __n) data[__a] = char_map(buffer[0]) << 4 |
+                                          char_map(buffer[1]);
+                if(__a < __n) dirty[__a / kPAGE] = true;
+                ++__a;
             }
        }
     }
@@ -1,8 +1,11 @@
 #ifndef _RISC_V_MEMIO_H_
 #define _RISC_V_MEMIO_H_
 
+#include "alu.h"
 #include "utility.h"
+#include "device.h"
 #include "memchip.h"
+#include "dram.h"
 #include "instruction.h"
 
 namespace dark {
@@ -10,6 +13,16 @@ namespace dark {
 
 constexpr address_type memory_size = 1 << 21;
 
+/**
+ * @brief Memory shared by all harts.
+ * Each hart keeps its own stores pending, and they are
+ * published here in hart order at a quantum barrier.
+ * 
+ */
+struct shared_memory : memory_chip <memory_size> {
+    console_device console; /* Memory-mapped device of all harts. */
+};
+
 /**
  * @brief A buffered fixed-sized memory chip.
  * 
@@ -19,16 +32,16 @@ struct memory : memory_chip <memory_size> {
     struct entry {
         word_utype code   :  3; /* The code */
         word_utype prev   :  5; /* Last store operation. */
-        word_utype        :  2;
+        word_utype busy   :  1; /* Whether working on a port. */
         word_utype dest   :  5; /* Index in the reorder buffer. */
-        word_utype idx1   :  5; /* Index of constraint1 in reorder. */
+        word_utype idx1   :  6; /* Physical register of constraint1. */
         word_stype offset : 12; /* Offset of address (with additional sign bit) */
 
         register_type  source1;  /* The source register value.           */
         register_type  source2;  /* Result of the calculation or source. */
 
-        /* Load signed or unsigned. */
-        bool sign() const noexcept { return code & 0b100; }
+        /* Load signed or unsigned. (True if signed) */
+        bool sign() const noexcept { return !(code & 0b100); }
         /* The bit_length of data.  */
         auto size() const noexcept { return code & 0b011; }
 
@@ -37,7 +50,7 @@ struct memory : memory_chip <memory_size> {
         /* Whether this command is done. */
         bool is_done()  const noexcept { return size() == 0b011; }
         /* Whether this command is available to operate. */
-        bool is_ready() const noexcept { return   idx1 == FREE;  }
+        bool is_ready() const noexcept { return idx1 == PHYS_FREE; }
 
         /* Return the real address. */
         address_type address() const noexcept
@@ -45,15 +58,52 @@ struct memory : memory_chip <memory_size> {
     }; static_assert(sizeof(entry) == 12);
 
 
+    static constexpr int kPORTS   = 4; /* Maximum of memory ports.   */
+    static constexpr int kLATENCY = 3; /* Cycles of a load or store. */
+
+    /* One memory port, working on a load or a store at a time. */
+    struct unit {
+        entry      current;         /* Current entry. */
+        byte_utype index;           /* Index of current in loader queue. */
+        word_stype cc = -1;         /* Stupid counter...... (wide for DRAM) */
+        bool load_tag = false;      /* Whether current is load operation. */
+        bool wait     = false;      /* Whether waiting for DRAM to issue. */
+
+        /* Whether the port is free. */
+        bool idle() const noexcept { return cc == -1; }
+    };
+
     round_queue <entry,32> loader;  /* Load  buffer.   */
-    entry current;                  /* Current  entry. */
+    unit port[kPORTS];              /* Memory ports.   */
+    int  ports = 1;                 /* Ports in use.   */
+    int  port_limit = kPORTS;       /* Ports loads may hold. (SMT) */
+    console_device console;         /* Memory-mapped device. */
+    dram_controller dram;           /* DRAM timing of the ports. */
+    bool     dram_enable = false;   /* Whether to use DRAM timing. */
+
+    /* A store not yet visible to other harts. */
+    struct pending_store {
+        address_type  addr;
+        register_type data;
+        size_t        size;
+    };
+
+    shared_memory *shared = nullptr;        /* Shared memory if a hart.  */
+    std::vector <pending_store> pending;    /* Stores of this quantum.   */
+    address_type reserve  = 0;              /* Address reserved by LR.   */
+    bool         reserved = false;          /* Whether reserve is valid. */
 
     address_type pc =   0 ;     /* PC pointer. */
 
-    bool   load_tag = false;    /* Whether current is load operation. */
     byte_utype last = FREE;     /* Last store RoB index in RoB. */
-    byte_utype index;           /* Index of current opeartion in loader queue. */
-    byte_stype  cc =  -1 ;      /* Stupid counter...... */
+    byte_utype last_saved[32];  /* Last store at each branch issued. */
+
+    /* Memory read by a done load, by RoB index. Cleared at issue. */
+    struct footprint {
+        address_type addr;
+        byte_utype   size;
+        bool         done;
+    } read_log[32] = {};
     /**
      * @brief Inner method of fetching a command.
      * Note that this command is only used in C++
@@ -63,35 +113,178 @@ struct memory : memory_chip <memory_size> {
      * @param __pc The real PC value.
      * @return command_type 
      */
-    void fetch(command_type &__cmd) noexcept { memory_chip::load(pc,__cmd,4); }
+    void fetch(command_type &__cmd) noexcept { fetch(pc,__cmd); }
+
+    /* Fetch the command at __pc, without moving PC. */
+    void fetch(address_type __pc,command_type &__cmd) noexcept {
+        if(shared) shared->load(__pc,__cmd,4);
+        else memory_chip::load(__pc,__cmd,4);
+    }
+
+    /* Load data from memory chip or device by address range. */
+    void read(address_type __pos,register_type &__v,size_t __m) noexcept {
+        if(console_device::in_range(__pos))
+            return void(__v = device().load(__pos));
+        if(!shared) return memory_chip::load(__pos,__v,__m);
+
+        /* Shared memory, overlaid by own pending stores in order. */
+        shared->load(__pos,__v,__m);
+        for(auto &&__s : pending) {
+            for(size_t i = 0 ; i != __m ; ++i) {
+                address_type __k = __pos + i - __s.addr;
+                if(__k >= __s.size) continue;
+                byte_utype __b = __s.data >> (__k << 3);
+                memcpy(reinterpret_cast <char *> (&__v) + i,&__b,1);
+            }
+        }
+    }
+
+    /* Store data into memory chip or device by address range. */
+    void write(address_type __pos,register_type __v,size_t __m) noexcept {
+        if(shared) {
+            pending.push_back({__pos,__v,__m});
+            /* Stop this hart at once, the others at the barrier. */
+            if(__pos == console_device::device_base + console_device::kEXIT)
+                console.exited = true;
+        } else if(console_device::in_range(__pos))
+            console.store(__pos,__v,__m);
+        else memory_chip::store(__pos,__v,__m);
+    }
+
+    /* The device in use: shared one if a hart. */
+    console_device &device() noexcept { return shared ? shared->console : console; }
+
+    /* The device in use: shared one if a hart. */
+    const console_device &device() const noexcept
+    { return shared ? shared->console : console; }
+
+    /* Join the shared memory as a hart. */
+    void share(shared_memory *__mem) noexcept { shared = __mem; }
+
+    /**
+     * @brief Make all pending stores visible to other harts.
+     * 
+     * @attention Only use it when no other hart is working.
+     */
+    void publish() noexcept {
+        for(auto &&__s : pending) {
+            if(shared->console.exited) break;
+            if(console_device::in_range(__s.addr))
+                shared->console.store(__s.addr,__s.data,__s.size);
+            else shared->store(__s.addr,__s.data,__s.size);
+        } pending.clear();
+    }
+
+    /* Drop the reservation if another hart stores into it. */
+    void invalidate(address_type __pos,size_t __m) noexcept
+    { if(reserve < __pos + __m && __pos < reserve + 4) reserved = false; }
+
+    /**
+     * @brief Perform an atomic memory operation at once.
+     * 
+     * @return The value for the destination register.
+     */
+    register_type atomic(AMO_code __code,address_type __addr,
+                         register_type __reg) noexcept {
+        register_type __old = 0;
+        switch(__code) {
+            case AMO_code::LR :
+                read(__addr,__old,4);
+                reserve = __addr , reserved = true;
+                return __old;
+
+            case AMO_code::SC :
+                if(!reserved || reserve != __addr) return 1;
+                write(__addr,__reg,4);
+                reserved = false;
+                return 0;
+
+            default:
+                read(__addr,__old,4);
+                write(__addr,atomic_unit::work(__old,__reg,__code),4);
+                return __old;
+        }
+    }
+
+    /* Load data by memory code, with sign extension if required. */
+    register_type load_extend(word_utype __code,address_type __pos) noexcept {
+        register_type __v = 0;
+        read(__pos,__v,1 << (__code & 0b11));
+        if(!(__code & 0b100)) { /* Sign extension. */
+            if((__code & 0b11) == 0) __v = (int8_t)  __v;
+            if((__code & 0b11) == 1) __v = (int16_t) __v;
+        } return __v;
+    }
+
+    /* Whether the guest has requested to exit. */
+    bool is_exit() const noexcept
+    { return console.exited || (shared && shared->console.exited); }
 
     /**
      * @brief Work for one cycle. 
      * 
-     * @return Whether load information is done.
+     * @return Loads done in this cycle, one at most for each port.
      */
     return_list work() noexcept {
-        if(cc == -1 || cc-- || !load_tag) return {};
+        return_list __list;
+        for(int i = 0 ; i != ports ; ++i) {
+            auto &__u = port[i];
+            if(__u.cc == -1 || __u.wait || __u.cc-- || !__u.load_tag) continue;
+
+            /* Now the loading work is done and must be commited at once. */
+            __u.current.source2 = load_extend(__u.current.code,__u.current.address());
+            loader[__u.index].set_done();
+            read_log[__u.current.dest] =
+                {__u.current.address(),byte_utype(1 << __u.current.size()),true};
+            __list.push_back({__u.current.source2,__u.current.dest});
+        }
+        /* Data of a request issued now is there in __c cycles: this
+           cycle is one of them, so __c - 1 are left to count down. */
+        if(dram_enable) dram.tick([this](int __p,size_t __c) {
+            port[__p].wait = false;
+            port[__p].cc   = word_stype(__c - 1);
+        });
+        return __list;
+    }
 
-        /* Now the loading work is done and must be commited at once. */
-        memory_chip::load(current.address(),
-                          current.source2,
-                          1 << current.size());
+    /* Clear the pipeline when prediction fails. */
+    void clear_pipeline() noexcept {
+        loader.clear() , last = FREE;
+        for(auto &__u : port) __u.load_tag = __u.wait = false , __u.cc = -1;
+        dram.clear();
+    }
 
-        /* Sign extension or not. */
-        if(current.sign()) {
-            if(current.size() == 0)
-                current.source2 = (int8_t)  current.source2;
-            if(current.size() == 1)
-                current.source2 = (int16_t) current.source2;
-        } loader[index].set_done();
+    /* Save the last store for the branch at RoB index __pos. */
+    void checkpoint(word_utype __pos) noexcept { last_saved[__pos] = last; }
 
-        return {{current.source2,current.dest}};
+    /**
+     * @brief Squash the commands after the branch at RoB index __pos.
+     * Commands whose RoB index fails __alive are younger or commited.
+     */
+    template <class F>
+    void squash(word_utype __pos,F &&__alive) noexcept {
+        last = last_saved[__pos];
+        if(last != FREE && !__alive(last)) last = FREE; /* Commited. */
+        while(loader.size() && !__alive(loader.back().dest)) loader.pop_back();
+        for(int i = 0 ; i != ports ; ++i)
+            if(port[i].load_tag && !__alive(port[i].current.dest))
+                port[i].load_tag = false;
     }
 
-    /* Clear the pipeline when prediction fails. */
-    void clear_pipeline() noexcept
-    { loader.clear() , last = FREE, load_tag = false , cc = -1; }
+    /* Reset to the state of a new memory, zeroing only written pages. */
+    void reset() noexcept {
+        memory_chip::clear();
+        clear_pipeline();
+        console.reset();
+        console.muted = false;
+        pc     = 0;
+        shared = nullptr;
+        ports  = 1 , port_limit = kPORTS;
+        dram = dram_controller();
+        dram_enable = false;
+        pending.clear();
+        reserve = 0 , reserved = false;
+    }
 
     /* A wire indicating whether the loader is full. */
     bool is_full() const noexcept { return loader.full(); }
@@ -105,7 +298,15 @@ struct memory : memory_chip <memory_size> {
                         word_utype __dest,
                         word_stype __offset,
                         wrapper    __data) noexcept
-    { loader.push({__code,last,__dest,__data.index(),__offset,__data.value(),0}); }
+    { insert(__code,__dest,__offset,__data,last); }
+
+    /* Insert a load waiting for the store __prev only. (FREE if none) */
+    inline void insert (word_utype __code,
+                        word_utype __dest,
+                        word_stype __offset,
+                        wrapper    __data,
+                        word_utype __prev) noexcept
+    { loader.push({__code,__prev,0,__dest,__data.idx,__offset,__data.value(),0}); }
 
     /* Special insert for store command. */
     void insert_store(word_utype __dest) { last = __dest; } 
@@ -119,24 +320,55 @@ struct memory : memory_chip <memory_size> {
                 word_utype  __dest,
                 address_type __addr,
                 address_type __reg2) noexcept {
-        if(last == __dest) last = FREE;
+        /**
+         * Take an idle port while under the port limit. Otherwise stop
+         * the load on (or queue after the store on) the first busy one.
+         * Commit cannot wait, so with no port held it takes the first.
+         */
+        unit *__u = port;
+        bool __free = busy_ports() < port_limit;
+        for(int i = 0 ; i != ports ; ++i)
+            if(port[i].idle() == __free) { __u = port + i; break; }
+        if(__u->load_tag) loader[__u->index].busy = false;
+        __u->load_tag = false , __u->cc += kLATENCY;  /* Store time. */
+        if(dram_enable) access(__u - port,__addr);
+        write(__addr,__reg2,1 << (__code & 0b11));
+        release(__dest);
+    }
 
-        load_tag = false , cc += 3;  /* Store time. */
-        memory_chip::store(__addr,__reg2,1 << (__code & 0b11));
+    /**
+     * @brief Find the loads which have read memory in [__pos,__pos + __m)
+     * too early. Loads whose RoB index fails __alive are not checked.
+     *
+     * @return The first such load found. (FREE if none)
+     */
+    template <class F>
+    word_utype conflict(address_type __pos,size_t __m,F &&__alive) const noexcept {
+        for(word_utype i = 0 ; i != FREE ; ++i) {
+            auto &__r = read_log[i];
+            if(__r.done && __r.addr < __pos + __m && __pos < __r.addr + __r.size
+                        && __alive(i)) return i;
+        } return FREE;
+    }
+
+    /* Release loads waiting for the store (or atomic) commited. */
+    void release(word_utype __dest) noexcept {
+        if(last == __dest) last = FREE;
 
-        /* Update the prev pointers in the queue. */
+        /* Update the prev pointers in the queue. Done loads may linger
+           at the front, so all the entries are checked. */
         int head = loader.head;
         int size = loader.dist;
-        while(size-- && loader[head].prev == __dest) {
-            loader[head].prev = FREE;
+        while(size--) {
+            if(loader[head].prev == __dest) loader[head].prev = FREE;
             if(++head == loader.length()) head = 0;
         }
     }
 
     /**
-     * @brief Update the dependency from RoB commit.
+     * @brief Wake up commands on a physical register written.
      * 
-     * @param wrapper Register file modification.
+     * @param wrapper Value with the physical tag as idx.
      * @attention Use it after insertion.
      */
     void update(wrapper __data) noexcept {
@@ -144,8 +376,8 @@ struct memory : memory_chip <memory_size> {
         int size = loader.dist;
         while(size--) {
             auto &__c = loader[head];
-            if(__c.idx1 == __data.index()) {
-                __c.idx1    = FREE;
+            if(__c.idx1 == __data.idx) {
+                __c.idx1    = PHYS_FREE;
                 __c.source1 = __data.value();
             } if(++head == loader.length()) head = 0;
         }
@@ -160,25 +392,47 @@ struct memory : memory_chip <memory_size> {
      * in the end of a cycle.
      */
     void sync() noexcept {
-        /* Is calculating. */
-        if(cc != -1) return;
-
         /* Pop out all useless elements first. */
         while(loader.size() && loader.front().is_done()) loader.pop();
 
-        /* Find the first ready and undone , then work on it. */
+        /**
+         * Give the ready loads to idle ports, in any order among them.
+         * A load never passes the store it waits for, whose address is
+         * unknown until commited.
+         */
+        int __p  = 0;
+        int __n  = port_limit - busy_ports(); /* Loads which may start. */
         int head = loader.head;
         int size = loader.dist;
-        while(size-- && loader[head].prev == FREE) {
+        while(size--) {
             auto &__c = loader[head];
-            if(__c.is_ready() && !__c.is_done()) {
-                load_tag = true , cc += 3;
-                current  = __c;
-                index    = head; return;
+            if(__c.prev == FREE && __c.is_ready() && !__c.is_done() && !__c.busy) {
+                while(__p != ports && !port[__p].idle()) ++__p;
+                if(__p == ports || __n-- <= 0) return;
+                auto &__u = port[__p];
+                __c.busy = true;
+                __u.load_tag = true , __u.cc += kLATENCY;
+                __u.current  = __c;
+                __u.index    = head;
+                if(dram_enable) access(__p,__c.address());
             } if(++head == loader.length()) head = 0;
         }
     }
 
+    /* Port __p waits for DRAM to issue the access to __addr. */
+    void access(int __p,address_type __addr) {
+        dram.cancel(__p);
+        dram.push(__addr,__p);
+        port[__p].wait = true , port[__p].cc = 0;
+    }
+
+    /* Count of ports working. */
+    int busy_ports() const noexcept {
+        int __n = 0;
+        for(int i = 0 ; i != ports ; ++i) __n += !port[i].idle();
+        return __n;
+    }
+
     /* Capacity of the loader. */
     constexpr int capacity() const noexcept { return loader.length(); }
 
@@ -0,0 +1,139 @@
+#ifndef _RISC_V_MULTICORE_H_
+#define _RISC_V_MULTICORE_H_
+
+#include "cpu.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+namespace dark {
+
+/**
+ * @brief Sense-reversing spin barrier.
+ * The last thread to arrive runs the serial phase
+ * before all threads are released.
+ *
+ */
+struct spin_barrier {
+    const size_t total;             /* Count of threads. */
+    std::atomic <size_t> count {0}; /* Threads arrived.  */
+    std::atomic <bool>   sense {0}; /* Global sense.     */
+
+    explicit spin_barrier(size_t __n) noexcept : total(__n) {}
+
+    /**
+     * @brief Wait for all threads.
+     *
+     * @param __local Sense of the calling thread.
+     * @param __func  Serial phase, run by the last thread to arrive.
+     */
+    template <class F>
+    void wait(bool &__local,F &&__func) noexcept {
+        __local = !__local;
+        if(count.fetch_add(1,std::memory_order_acq_rel) + 1 == total) {
+            __func();
+            count.store(0,std::memory_order_relaxed);
+            sense.store(__local,std::memory_order_release);
+        } else {
+            for(size_t i = 0 ; sense.load(std::memory_order_acquire) != __local ; ++i)
+                if(i > 64) std::this_thread::yield();
+        }
+    }
+};
+
+
+/**
+ * @brief Several harts sharing one guest memory.
+ * Each hart runs on its own host thread for a quantum of cycles.
+ * Stores are kept private to a hart during the quantum. At the
+ * barrier, in hart order, every hart performs the atomic command
+ * at its RoB head (if any) and publishes its stores, which drops
+ * reservations of other harts on the same address. Hence memory
+ * is coherent at quantum boundaries and atomics are serialized.
+ *
+ */
+struct multicore {
+    size_t quantum = 16;    /* Cycles between two barriers. */
+
+    std::unique_ptr <shared_memory>    memory;  /* Shared guest memory. */
+    std::vector <cpu *>                harts;   /* All the harts.       */
+    std::vector <std::unique_ptr <cpu>> owned;  /* Harts except first.  */
+    std::vector <char>                 done;    /* Whether hart ended.  */
+    bool finished = false;                      /* Whether all ended.   */
+
+    /**
+     * @brief Build __n harts. The program image is taken from __main,
+     * which becomes hart 0.
+     */
+    void init(cpu &__main,size_t __n) {
+        memory = std::make_unique <shared_memory> ();
+        memcpy(memory->data,__main.data,memory_size);
+        harts.assign(1,&__main);
+        while(harts.size() < __n) {
+            owned.push_back(std::make_unique <cpu> ());
+            harts.push_back(owned.back().get());
+        }
+        for(size_t i = 0 ; i != harts.size() ; ++i) {
+            harts[i]->share(memory.get());
+            harts[i]->hartid = i;
+            harts[i]->ports  = __main.ports;
+            harts[i]->lvp_enable = __main.lvp_enable;
+            harts[i]->loop_enable = __main.loop_enable;
+            harts[i]->ss_enable   = __main.ss_enable;
+            harts[i]->fusion_enable = __main.fusion_enable;
+            harts[i]->elim_enable = __main.elim_enable;
+            harts[i]->fq_enable = __main.fq_enable;
+            harts[i]->fq_depth  = __main.fq_depth;
+            harts[i]->dram_enable = __main.dram_enable;
+            harts[i]->dram.configure(__main.dram.channels,__main.dram.banks);
+        } done.assign(harts.size(),false);
+    }
+
+    /* Serial phase at the barrier. */
+    void serial() noexcept {
+        for(size_t i = 0 ; i != harts.size() ; ++i) {
+            harts[i]->work_atomic();
+            for(auto &&__s : harts[i]->pending)
+                for(size_t j = 0 ; j != harts.size() ; ++j)
+                    if(j != i) {
+                        harts[j]->invalidate(__s.addr,__s.size);
+                        harts[j]->loop_invalidate(__s.addr,__s.size);
+                    }
+            harts[i]->publish();
+        }
+
+        size_t __cnt = 0;
+        for(auto __d : done) __cnt += __d;
+        finished = memory->console.exited || __cnt == done.size();
+    }
+
+    /* Run all harts until all of them end or the guest exits. */
+    void run() {
+        spin_barrier __barrier(harts.size());
+        std::vector <std::thread> __pool;
+        for(size_t i = 0 ; i != harts.size() ; ++i) {
+            __pool.emplace_back([&,i]() {
+                bool __sense = false;
+                while(!finished) {
+                    for(size_t j = 0 ; j != quantum && !done[i] ; ++j)
+                        done[i] = !harts[i]->work();
+                    __barrier.wait(__sense,[this]() { serial(); });
+                }
+            });
+        } for(auto &__t : __pool) __t.join();
+        memory->console.flush();
+    }
+
+    /* Print statistics of each hart. */
+    void print(std::ostream &__os) const {
+        for(size_t i = 0 ; i != harts.size() ; ++i)
+            __os << "Hart " << i << ": clock " << harts[i]->clock
+                 << ", instructions " << harts[i]->instructions()
+                 << ", a0 " << harts[i]->arch(10) << '\n';
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef _RISC_V_POOL_H_
+#define _RISC_V_POOL_H_
+
+#include "cpu.h"
+
+#include <memory>
+
+namespace dark {
+
+/**
+ * @brief A pool reusing cpu objects for batch workloads.
+ * A cpu given back is reset at once, zeroing only the
+ * memory pages written, so it is ready to be taken again.
+ * 
+ */
+struct cpu_pool {
+    std::vector <std::unique_ptr <cpu>> idle; /* Reset cpu ready to use. */
+
+    /* Take a cpu in the state of a new one. */
+    std::unique_ptr <cpu> acquire() {
+        if(idle.empty()) return std::make_unique <cpu> ();
+        auto __c = std::move(idle.back());
+        idle.pop_back();
+        return __c;
+    }
+
+    /* Give back a cpu that is no longer used. */
+    void release(std::unique_ptr <cpu> __c) {
+        __c->reset();
+        idle.push_back(std::move(__c));
+    }
+
+    /* Count of idle cpu in the pool. */
+    size_t size() const noexcept { return idle.size(); }
+};
+
+}
+
+#endif
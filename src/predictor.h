@@ -3,12 +3,16 @@
 
 #include "utility.h"
 
+#include <stdio.h>
+
 
 namespace dark {
 
 struct predictor {
     static constexpr uint32_t kAND = 0x0fff;
     static constexpr uint32_t kLEN = 0x1000;
+    static constexpr uint32_t kMAGIC = 0x52504b44; /* "DKPR" in file. */
+    static constexpr uint32_t kTAKEN = 1u << 31;  /* Predicted taken bit. */
     static constexpr uint32_t next_state[4][2] {
         {1,3},
         {1,0},
@@ -49,27 +53,109 @@ struct predictor {
 
     /* Predict according to pc. */
     bool predict(address_type __pc) noexcept {
-        uncommited.push({__pc &= kAND});
-        return mapping[__pc].try_predict();
+        bool __result = mapping[__pc &= kAND].try_predict();
+        uncommited.push({__pc | (__result ? kTAKEN : 0)});
+        return __result;
     }
 
-    /* Update the prediciton from commit message. */
+    /**
+     * @brief Update the prediciton from commit message.
+     * A wrong prediction has been repaired by squash() already.
+     */
     void update_prediction(bool wrong,bool result)
     noexcept {
         ++count[wrong];
-        // return;
-        mapping[uncommited.front()].set_state(result);
-        if(!wrong) uncommited.pop();
-        else { /* The prediction is wrong! */
-            int head = uncommited.head;
-            int size = uncommited.dist;
-            while(size--) {
-                mapping[uncommited[head]].clear();
-                if(++head == uncommited.length()) head = 0;
-            } uncommited.clear();
+        mapping[uncommited.front() & kAND].set_state(result);
+        uncommited.pop();
+    }
+
+    /* Drop all uncommited predictions. */
+    void clear_pipeline() noexcept { replay(0); }
+
+    /**
+     * @brief Keep only the first __n uncommited predictions, and
+     * rebuild the speculative history from the ones kept.
+     */
+    void replay(int __n) noexcept {
+        int head = uncommited.head;
+        int size = uncommited.dist;
+        while(size--) {
+            mapping[uncommited[head] & kAND].clear();
+            if(++head == uncommited.length()) head = 0;
+        } uncommited.dist = __n;
+
+        head = uncommited.head;
+        while(__n--) {
+            auto &__e = mapping[uncommited[head] & kAND];
+            __e.predict = __e.predict << 1 | bool(uncommited[head] & kTAKEN);
+            if(++head == uncommited.length()) head = 0;
         }
     }
 
+    /**
+     * @brief Squash predictions after a mispredicted branch.
+     * 
+     * @param __pos    Index of the branch in the uncommited queue.
+     * @param __result Real result of the branch.
+     */
+    void squash(int __pos,bool __result) noexcept {
+        int __n = __pos - uncommited.head;
+        if(__n < 0) __n += uncommited.length();
+        uncommited[__pos] = (uncommited[__pos] & kAND) | (__result ? kTAKEN : 0);
+        replay(__n + 1);
+    }
+
+    /* Drop the last prediction, made for a command thrown away. */
+    void cancel_last() noexcept { replay(uncommited.dist - 1); }
+
+    /**
+     * @brief Train with a resolved branch out of the pipeline.
+     * Used in functional warming, so statistics are not touched.
+     * 
+     * @attention Only use it when no prediction is uncommited.
+     */
+    void warm(address_type __pc,bool result) noexcept {
+        auto &__e = mapping[__pc & kAND];
+        __e.set_state(result);
+        __e.clear();
+    }
+
+    /**
+     * @brief Bias the initial counters of a branch by its direction.
+     * Backward branches (loops) start as weakly taken in every pattern.
+     */
+    void hint(address_type __pc,bool __backward) noexcept {
+        auto &__e = mapping[__pc & kAND];
+        __e.data = __backward ? ~0u : 0u;
+    }
+
+    /* Dump the prediction tables into a file. */
+    bool save(const char *__path) const noexcept {
+        FILE *__f = fopen(__path,"wb");
+        if(!__f) return false;
+        uint32_t __head[2] = {kMAGIC,kLEN};
+        bool __ok = fwrite(__head,sizeof(__head),1,__f) == 1
+                 && fwrite(mapping,sizeof(mapping),1,__f) == 1;
+        return fclose(__f) == 0 && __ok;
+    }
+
+    /* Load the prediction tables from a file. Return false if invalid. */
+    bool load(const char *__path) noexcept {
+        FILE *__f = fopen(__path,"rb");
+        if(!__f) return false;
+        uint32_t __head[2];
+        entry __tmp[kLEN];
+        bool __ok = fread(__head,sizeof(__head),1,__f) == 1
+                 && __head[0] == kMAGIC && __head[1] == kLEN
+                 && fread(__tmp,sizeof(__tmp),1,__f) == 1;
+        fclose(__f);
+        if(!__ok) return false;
+        for(uint32_t i = 0 ; i != kLEN ; ++i) {
+            mapping[i] = __tmp[i];
+            mapping[i].clear(); /* Drop uncommited history. */
+        } return true;
+    }
+
     /* Get the accuracy for reference. */
     double get_accuracy() const noexcept
     { return static_cast <double> (count[0]) / (count[0] + count[1]); }
@@ -0,0 +1,252 @@
+#ifndef _RISC_V_PROFILER_H_
+#define _RISC_V_PROFILER_H_
+
+#include "utility.h"
+#include "instruction.h"
+
+#include <map>
+#include <iomanip>
+#include <fstream>
+#include <algorithm>
+#include <unordered_map>
+
+namespace dark {
+
+/**
+ * @brief Guest call-graph profiler on the commited stream.
+ * jal/jalr with rd = ra is a call, jalr x0,0(ra) is a return.
+ * A shadow call stack charges cycles and commands to functions
+ * (by entry PC) exclusively and inclusively, to caller-callee
+ * edges, and to whole stacks for flame graphs.
+ *
+ * Cycles between two commits go to the function of the later one.
+ * A recursive function counts inclusive time at its outermost frame.
+ * Tail calls (jal x0) stay in the caller.
+ *
+ */
+struct call_profiler {
+    static constexpr uint32_t kRA = 1; /* Register of return address. */
+
+    struct function {
+        size_t self_cycles  = 0;    /* Cycles in the function itself. */
+        size_t self_insts   = 0;    /* Commands in the function itself. */
+        size_t total_cycles = 0;    /* Cycles with the callees. */
+        size_t total_insts  = 0;    /* Commands with the callees. */
+        size_t calls        = 0;    /* Times called. */
+        int    active       = 0;    /* Frames on the stack now. */
+    };
+
+    struct edge {
+        size_t calls  = 0;          /* Times called by the caller. */
+        size_t cycles = 0;          /* Inclusive cycles of these calls. */
+        size_t insts  = 0;          /* Inclusive commands of these calls. */
+    };
+
+    struct frame {
+        address_type func;          /* Entry PC. */
+        address_type ret;           /* Return address. */
+        size_t clock;               /* Clock at entry. */
+        size_t insts;               /* Commands at entry. */
+        int    node;                /* Node of the whole stack. */
+        function *info;
+    };
+
+    /* One distinct stack, for folded output. */
+    struct node {
+        int          parent;
+        address_type func;
+        size_t       cycles = 0;    /* Exclusive cycles of the stack. */
+    };
+
+    std::unordered_map <address_type,function> funcs;
+    std::map <std::pair <address_type,address_type>,edge> edges;
+    std::map <std::pair <int,address_type>,int> children;
+    std::map <address_type,std::string> symbols;
+    std::vector <node>  nodes;
+    std::vector <frame> stack;
+
+    address_type pc_of[32];     /* PC of the command in a RoB position. */
+    command_type cmd_of[32];    /* The command in a RoB position. */
+    bool        pair_of[32];    /* Whether it is a fused pair. */
+    address_type  to_of[32];    /* Jump target of a fused pair. */
+    size_t last  = 0;           /* Clock of the last commit. */
+    size_t insts = 0;           /* Commands commited. */
+
+    call_profiler() { enter(0,0,0); }
+
+    /**
+     * @brief Load symbols in `nm` format ("addr type name" per line).
+     * Only text symbols are kept.
+     *
+     * @return Whether the file is read.
+     */
+    bool load_symbols(const char *__path) {
+        std::ifstream __in(__path);
+        std::string __addr,__type,__name;
+        while(__in >> __addr >> __type >> __name)
+            if(__type == "T" || __type == "t")
+                symbols[std::stoul(__addr,nullptr,16)] = __name;
+        return !__in.bad() && __in.eof();
+    }
+
+    /**
+     * @brief A command is issued into RoB position __pos.
+     *
+     * @param __pair Whether it is the second of a fused pair.
+     * @param __to   Target of a fused jalr, not in the commit value.
+     */
+    void issue(int __pos,address_type __pc,command_type __cmd,
+               bool __pair = false,address_type __to = 0) noexcept {
+        pc_of[__pos] = __pc , cmd_of[__pos] = __cmd;
+        pair_of[__pos] = __pair , to_of[__pos] = __to;
+    }
+
+    /**
+     * @brief The command in RoB position __pos is commited.
+     *
+     * @param __value Commit value (the target for jalr).
+     */
+    void commit(int __pos,size_t __clock,register_type __value) {
+        auto &__top = stack.back();
+        __top.info->self_cycles += __clock - last;
+        __top.info->self_insts  += 1 + pair_of[__pos];
+        nodes[__top.node].cycles += __clock - last;
+        last = __clock , insts += 1 + pair_of[__pos];
+
+        instruction __inst = {cmd_of[__pos]};
+        address_type __pc  = pc_of[__pos];
+        if(pair_of[__pos]) __value = to_of[__pos];
+        if(__inst.suc == suc_code::jal && __inst.rd == kRA)
+            return call(__pc + __inst.J_immediate(),__pc + 4,__clock);
+        if(__inst.suc != suc_code::jalr) return;
+        if(__inst.rd == kRA) return call(__value & ~1,__pc + 4,__clock);
+        if(__inst.rd == 0 && __inst.rs1 == kRA) return ret(__value & ~1,__clock);
+    }
+
+    /* The program ends: unwind all frames. */
+    void finish(size_t __clock) {
+        stack.back().info->self_cycles += __clock - last;
+        nodes[stack.back().node].cycles += __clock - last;
+        last = __clock;
+        while(!stack.empty()) leave(__clock);
+    }
+
+    /* Name of a function. */
+    std::string name(address_type __func) const {
+        auto __it = symbols.find(__func);
+        if(__it != symbols.end()) return __it->second;
+        char __buf[16];
+        sprintf(__buf,"0x%08x",__func);
+        return __buf;
+    }
+
+    /* Print gprof-style flat profile and call graph. */
+    void print(std::ostream &__os) const {
+        std::vector <std::pair <address_type,const function *>> __list;
+        for(auto &&[__f,__i] : funcs) __list.push_back({__f,&__i});
+        std::sort(__list.begin(),__list.end(),[](auto &__x,auto &__y) {
+            return __x.second->self_cycles != __y.second->self_cycles ?
+                   __x.second->self_cycles  > __y.second->self_cycles :
+                   __x.first < __y.first;
+        });
+        double __all = last ? last : 1;
+
+        __os << "Flat profile:\n\n"
+             << "  %time   cumulative         self        calls   self-insts"
+                "        total  name\n"
+             << "            (cycles)      (cycles)                          "
+                "     (cycles)\n";
+        size_t __sum = 0;
+        for(auto &&[__f,__i] : __list) {
+            __sum += __i->self_cycles;
+            __os << std::fixed << std::setprecision(2) << std::setw(7)
+                 << 100.0 * __i->self_cycles / __all
+                 << std::setw(13) << __sum
+                 << std::setw(13) << __i->self_cycles
+                 << std::setw(13) << __i->calls
+                 << std::setw(13) << __i->self_insts
+                 << std::setw(13) << __i->total_cycles
+                 << "  " << name(__f) << '\n';
+        }
+
+        __os << "\nCall graph:\n\n"
+             << "index  %time         self     children        called  name\n";
+        std::map <address_type,size_t> __index;
+        for(size_t i = 0 ; i != __list.size() ; ++i) __index[__list[i].first] = i + 1;
+        auto __tag = [&](address_type __f) {
+            return name(__f) + " [" + std::to_string(__index[__f]) + "]";
+        };
+        for(auto &&[__f,__i] : __list) {
+            __os << "-----------------------------------------------\n";
+            for(auto &&[__k,__e] : edges) if(__k.second == __f)
+                __os << "             " << std::setw(13) << ' '
+                     << std::setw(13) << __e.cycles << std::setw(14)
+                     << __e.calls << "      " << __tag(__k.first) << '\n';
+            __os << std::setw(5) << std::left
+                 << "[" + std::to_string(__index[__f]) + "]" << std::right
+                 << std::setw(8) << 100.0 * __i->total_cycles / __all
+                 << std::setw(13) << __i->self_cycles
+                 << std::setw(13) << __i->total_cycles - __i->self_cycles
+                 << std::setw(14) << __i->calls << "  " << __tag(__f) << '\n';
+            for(auto &&[__k,__e] : edges) if(__k.first == __f)
+                __os << "             " << std::setw(13) << ' '
+                     << std::setw(13) << __e.cycles << std::setw(14)
+                     << __e.calls << "          " << __tag(__k.second) << '\n';
+        } __os << "-----------------------------------------------\n"
+               << std::defaultfloat;
+    }
+
+    /* Print folded stacks ("f1;f2;f3 cycles" per line) for flame graphs. */
+    void print_folded(std::ostream &__os) const {
+        std::vector <std::string> __path(nodes.size());
+        for(size_t i = 0 ; i != nodes.size() ; ++i) {
+            auto &__n = nodes[i];   /* Parents are always made first. */
+            __path[i] = __n.parent < 0 ? name(__n.func)
+                      : __path[__n.parent] + ';' + name(__n.func);
+            if(__n.cycles) __os << __path[i] << ' ' << __n.cycles << '\n';
+        }
+    }
+
+  private:
+
+    /* Push a frame of function __func. */
+    void enter(address_type __func,address_type __ret,size_t __clock) {
+        int __parent = stack.empty() ? -1 : stack.back().node;
+        auto [__it,__new] = children.try_emplace({__parent,__func},nodes.size());
+        if(__new) nodes.push_back({__parent,__func});
+        auto &__info = funcs[__func];
+        ++__info.calls , ++__info.active;
+        stack.push_back({__func,__ret,__clock,insts,__it->second,&__info});
+    }
+
+    /* Pop the top frame. */
+    void leave(size_t __clock) {
+        auto __top = stack.back();
+        stack.pop_back();
+        size_t __cycles = __clock - __top.clock;
+        size_t __insts  = insts - __top.insts;
+        if(--__top.info->active) return; /* Inner frame of a recursion. */
+        __top.info->total_cycles += __cycles;
+        __top.info->total_insts  += __insts;
+        if(stack.empty()) return;
+        auto &__e = edges[{stack.back().func,__top.func}];
+        __e.cycles += __cycles , __e.insts += __insts;
+    }
+
+    void call(address_type __func,address_type __ret,size_t __clock) {
+        edges[{stack.back().func,__func}].calls++;
+        enter(__func,__ret,__clock);
+    }
+
+    /* Return to __ret: pop to the frame which returns there, if any. */
+    void ret(address_type __ret,size_t __clock) {
+        size_t __n = stack.size();
+        while(__n > 1 && stack[__n - 1].ret != __ret) --__n;
+        if(__n == 1) return; /* No such frame: not a return. */
+        while(stack.size() >= __n) leave(__clock);
+    }
+};
+
+}
+
+#endif
@@ -5,86 +5,163 @@
 
 namespace dark {
 
-/* Register status holder. */
+/**
+ * @brief Merged physical register file with rename map.
+ * Each command writing a register gets a new physical register
+ * at issue. Its result is written there once done, and consumers
+ * wake up on the physical tag. Commit only moves the commited map
+ * and frees the physical register overwritten. A move may share the
+ * physical register of its source: it is freed when the last of them
+ * is overwritten.
+ * 
+ */
 struct register_file {
-    union {
-        register_type reg[32];
-        struct { /* Specific registers. */
-            register_type zero; /* Hardwired 0. */
-            register_type ra;   /* Return address.  */
-            register_type sp;   /* Stack pointer. */
-            register_type gp;   /* Global pointer. */
-            register_type tp;   /* Thread pointer. */
-            register_type t0;   /* Temporary. */
-            register_type t1;   /* Temporary. */
-            register_type t2;   /* Temporary. */
-            union {
-                register_type s0;   /* Saved register. */
-                register_type fp;   /* Frame pointer. */  
-            };
-            register_type s1;   /* Saved register. */
-            register_type a0;   /* Function argument,return value. */
-            register_type a1;   /* Function argument,return value. */
-            register_type a2;   /* Function arugment. */        
-            register_type a3;   /* Function arugment. */        
-            register_type a4;   /* Function arugment. */        
-            register_type a5;   /* Function arugment. */        
-            register_type a6;   /* Function arugment. */        
-            register_type a7;   /* Function arugment. */        
-            register_type s2;   /* Saved register. */
-            register_type s3;   /* Saved register. */
-            register_type s4;   /* Saved register. */
-            register_type s5;   /* Saved register. */
-            register_type s6;   /* Saved register. */
-            register_type s7;   /* Saved register. */
-            register_type s8;   /* Saved register. */
-            register_type s9;   /* Saved register. */
-            register_type s10;  /* Saved register. */
-            register_type s11;  /* Saved register. */
-            register_type t3;   /* Temoporary. */
-            register_type t4;   /* Temoporary. */
-            register_type t5;   /* Temoporary. */
-            register_type t6;   /* Temoporary. */
-        };
-    };
-
-    byte_utype nxt[32]; /* Dependency of register. */
+    static constexpr uint32_t kPHYS = PHYS_FREE; /* 32 + RoB capacity. */
+
+    register_type phys[kPHYS];  /* Physical registers. (0 is hardwired 0) */
+    uint64_t      ready;        /* Whether a physical register is written. */
+    byte_utype    map[32];      /* Speculative rename map. */
+    byte_utype    retire[32];   /* Rename map of commited state. */
+    round_queue <byte_utype,64> free_list;  /* Free physical registers. */
+    byte_utype    aliases[kPHYS]; /* Registers sharing one, besides the first. */
+
+    /* Renaming state saved at a branch. */
+    struct snapshot {
+        byte_utype map[32];
+        int        head;    /* Head of free list. */
+    } saved[32];    /* Indexed by RoB index of the branch. */
+
+    register_type hartid = 0; /* Value of CSR mhartid. */
 
     /* Intialization. */
     register_file() noexcept {
-        memset(reg,  0 ,sizeof(reg));  
-        memset(nxt,FREE,sizeof(nxt)); /* Free. */
+        memset(phys,0,sizeof(phys));
+        memset(aliases,0,sizeof(aliases));
+        for(byte_utype i = 0 ; i != 32 ; ++i) map[i] = retire[i] = i;
+        for(byte_utype i = 32 ; i != kPHYS ; ++i) free_list.push(i);
+        ready = ~0ull;
     }
 
+    /* Architectural register value. */
+    register_type &arch(word_utype __idx) noexcept { return phys[retire[__idx]]; }
+
+    /* Architectural register value. */
+    register_type arch(word_utype __idx) const noexcept { return phys[retire[__idx]]; }
+
     /**
-     * @brief Commit a order from reorder buffer.
-     * 
-     * @param __idx Index in the register file.
-     * @param __pos Index in the reorder buffer.
-     * @param __new Value of the new register data.
+     * @brief Write an architectural register out of the pipeline, as in
+     * functional mode. (The pipeline must be empty.) A register sharing
+     * its physical register with a move takes a free one of its own,
+     * so that the others keep their value.
      */
-    void commit(word_utype __idx,word_utype __pos,
-                register_type __new) noexcept {
-        if(__idx) reg[__idx] = __new;
-        if(nxt[__idx] == __pos) nxt[__idx] = FREE;
+    void write_arch(word_utype __idx,register_type __val) noexcept {
+        if(!__idx) return;
+        byte_utype &__p = retire[__idx];
+        if(aliases[__p]) {
+            --aliases[__p];
+            __p = free_list.front();
+            free_list.pop();
+            map[__idx] = __p;
+            ready |= 1ull << __p;
+        } phys[__p] = __val;
     }
 
     /**
-     * @brief Marking one register as occupied.
-     * Note that 0 register won't be occupied.
+     * @brief Give a new physical register to one register.
+     * Note that 0 register won't be renamed.
      * 
      * @param __idx Index of the register.
-     * @param __pos Index in the reorder buffer.
+     * @param __old The physical register replaced, to free at commit.
+     * @return The new physical register. (0 if __idx is 0)
      */
-    void insert(word_utype __idx,byte_utype __pos)
-    noexcept { if(__idx) nxt[__idx] = __pos; }
+    byte_utype rename(word_utype __idx,byte_utype &__old) noexcept {
+        if(!__idx) return __old = 0;
+        byte_utype __new = free_list.front();
+        free_list.pop();
+        ready &= ~(1ull << __new);
+        __old = map[__idx];
+        return map[__idx] = __new;
+    }
+
+    /**
+     * @brief Map one register to the physical register of __src,
+     * as a move done at rename.
+     *
+     * @param __old The physical register replaced, to free at commit.
+     * @return The physical register shared.
+     */
+    byte_utype alias(word_utype __idx,word_utype __src,byte_utype &__old) noexcept {
+        byte_utype __new = map[__src];
+        ++aliases[__new];
+        __old = map[__idx];
+        return map[__idx] = __new;
+    }
+
+    /* Drop a sharing of __pos by a move squashed. */
+    void unshare(byte_utype __pos) noexcept { --aliases[__pos]; }
 
-    /* Whether the current register is busy. (-1 -> not busy) */
-    wrapper reorder(byte_utype __pos) const noexcept
-    { return {reg[__pos],nxt[__pos]}; }
+    /* Write a result into physical register __pos. */
+    void write(byte_utype __pos,register_type __val) noexcept {
+        if(!__pos) return;
+        phys[__pos] = __val;
+        ready |= 1ull << __pos;
+    }
+
+    /**
+     * @brief Commit a order from reorder buffer.
+     * 
+     * @param __idx Index in the register file.
+     * @param __new Physical register commited.
+     * @param __old Physical register replaced by it.
+     */
+    void commit(word_utype __idx,byte_utype __new,byte_utype __old) noexcept {
+        if(!__idx) return;
+        retire[__idx] = __new;
+        if(aliases[__old]) --aliases[__old];
+        else free_list.push(__old);
+    }
+
+    /* Value of a register, or its physical tag if not written yet. */
+    wrapper reorder(byte_utype __pos) const noexcept {
+        byte_utype __x = map[__pos];
+        if(ready >> __x & 1) return {phys[__x],PHYS_FREE};
+        return {0,__x};
+    }
+
+    /* Save the renaming state for the branch at RoB index __pos. */
+    void checkpoint(byte_utype __pos) noexcept {
+        auto &__s = saved[__pos];
+        memcpy(__s.map,map,sizeof(map));
+        __s.head = free_list.head;
+    }
+
+    /**
+     * @brief Restore the renaming state saved for the branch at __pos.
+     * Physical registers taken since then go back to the free list.
+     */
+    void restore(byte_utype __pos) noexcept {
+        auto &__s = saved[__pos];
+        memcpy(map,__s.map,sizeof(map));
+        int __n = free_list.head - __s.head;
+        if(__n < 0) __n += free_list.length();
+        free_list.head  = __s.head;
+        free_list.dist += __n;
+    }
 
     /* Clear the pipeline when prediction fails. */
-    void clear_pipeline() noexcept { memset(nxt,FREE,sizeof(nxt)); }
+    void clear_pipeline() noexcept {
+        uint64_t __used = 0;
+        memcpy(map,retire,sizeof(map));
+        memset(aliases,0,sizeof(aliases));
+        for(auto __x : retire) {
+            if(__used >> __x & 1) ++aliases[__x];
+            __used |= 1ull << __x;
+        }
+        free_list.clear();
+        for(byte_utype i = 1 ; i != kPHYS ; ++i)
+            if(!(__used >> i & 1)) free_list.push(i);
+        ready = ~0ull;
+    }
 };
 
 }
@@ -9,14 +9,17 @@ namespace dark {
 /* The buffer for */
 struct reorder_buffer {
     struct entry {
-        word_utype     result;  /* Result of the calculation. */
+        word_utype     result;  /* Branch, jalr, store or atomic data. */
         word_utype   done : 1;  /* Whether command done tag.  */
-        word_utype    tag : 2;  /* Tag of type of command.    */
+        word_utype    tag : 3;  /* Tag of type of command.    */
         word_utype   dest : 5;  /* Destination in register file. */
+        word_utype   phys : 6;  /* Physical register of destination. */
+        word_utype    old : 6;  /* Physical register to free at commit. */
     }; static_assert(sizeof(entry) == 8);
 
     round_queue <entry,FREE> queue; /* The round queue inside. */
     bool sync_tag = false;          /* The sync tag.           */
+    size_t committed = 0;           /* Count of commands commited. */
 
     /**
      * @brief Work in one cycle. 
@@ -25,7 +28,7 @@ struct reorder_buffer {
      */
     wrapper work() noexcept {
         if(queue.size() && queue.front().done) {
-            sync_tag = true;
+            sync_tag = true , ++committed;
             auto __tmp = queue.front();
             return {__tmp.result,(address_type)(__tmp.tag << 5) | __tmp.dest};
         } else return {0,0};
@@ -37,6 +40,22 @@ struct reorder_buffer {
     /* A wire of the next available address in queue. */
     uint32_t buffer_tail() const noexcept { return queue.tail(); }
 
+    /* Age of the command at index __pos. (0 for the head) */
+    int age(uint32_t __pos) const noexcept {
+        int __x = __pos - queue.head;
+        return __x < 0 ? __x + queue.length() : __x;
+    }
+
+    /**
+     * @brief Whether the command at __pos is no younger than one of
+     * age __max, and not commited. (The head goes away in this cycle
+     * if sync_tag is set)
+     */
+    bool alive(uint32_t __pos,int __max) const noexcept {
+        int __x = age(__pos);
+        return __x <= __max && __x >= int(sync_tag);
+    }
+
     /* Whether the buffer is full. */
     bool is_full() const noexcept { return queue.full();  }
 
@@ -62,17 +81,22 @@ struct reorder_buffer {
      * 
      * @param __arg If BRANCH, __arg = pc (loweset bit = predicition)
      * If STORE, __arg = data_pack (parsed command)
-     * If JAL/AUIPC/LUI , __arg = new result (And naturally, done = true) 
-     * If other cases, __arg = 0.
+     * If ATOMIC, __arg = data_pack (parsed command)
+     * If other cases, __arg = 0. (Results go to physical registers)
+     * @param __phys Physical register of __dest, and __old the one replaced.
      * @attention Use it in the end of a cycle.
      */
     void insert(word_utype  __arg,word_utype  __tag,
-                word_utype __dest,word_utype __done)
-    noexcept { queue.push({__arg,__done,__tag,__dest}); }
+                word_utype __dest,word_utype __done,
+                word_utype __phys,word_utype  __old)
+    noexcept { queue.push({__arg,__done,__tag,__dest,__phys,__old}); }
 
     /* Clear the pipeline when prediction fails. */
     void clear_pipeline() noexcept { queue.clear(); sync_tag = false; }
 
+    /* Keep only the oldest __n commands, squashing the younger. */
+    void squash(int __n) noexcept { queue.dist = __n; }
+
     /**
      * @brief This fucking operation is designed to 
      * simulate real hardware, as real hardware relies
@@ -83,6 +107,9 @@ struct reorder_buffer {
      */
     void sync() noexcept { if(sync_tag) queue.pop() , sync_tag = false; }
 
+    /* Return the total of commands commited. */
+    size_t instructions() const noexcept { return committed; }
+
     /* Return the capacity of the reorder buffer. */
     constexpr int capacity() const noexcept { return queue.length(); }
 };
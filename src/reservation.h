@@ -11,16 +11,16 @@ struct reservation_station {
     struct entry {
         ALU_code    op  : 7;    /* Operator bit.     */
         byte_utype      : 1;
-        byte_utype idx1 : 5;    /* Index of constraint 1 reorder. */
-        byte_utype idx2 : 5;    /* Index of constraint 2 reorder.  */
+        byte_utype idx1 : 6;    /* Physical register of constraint 1. */
+        byte_utype idx2 : 6;    /* Physical register of constraint 2. */
         byte_utype dest : 5;    /* Index of destination in reorder buffer. */
-        byte_utype      : 1;
+        byte_utype      : 3;
         register_type  src1;    /* Source value 1. */
         register_type  src2;    /* Source value 2.  */
         register_type result;   /* The result of reservation station. */
 
         /* Whether this entry is available to be executed. */
-        bool is_ready() const noexcept { return idx1 == FREE && idx2 == FREE; }
+        bool is_ready() const noexcept { return idx1 == PHYS_FREE && idx2 == PHYS_FREE; }
     }; static_assert(sizeof(entry) == 16);
 
 
@@ -56,6 +56,14 @@ struct reservation_station {
     void clear_pipeline() noexcept
     { array_state.reset(),array_syncs.set(); }
 
+    /* Squash the commands whose RoB index fails __alive. */
+    template <class F>
+    void squash(F &&__alive) noexcept {
+        for(auto i  = array_state._Find_first() ;
+                 i != array_state.size() ; i = array_state._Find_next(i))
+            if(!__alive(array[i].dest)) array_state[i] = false;
+    }
+
 
     /**
      * @brief Receive one command from issue.
@@ -69,27 +77,28 @@ struct reservation_station {
         int __x = (~array_state)._Find_first();
         array_state[__x]= true; /* Set occupied. */
         array[__x].op   = __code;
-        array[__x].idx1 = __reg1.index();
-        array[__x].idx2 = __reg2.index();
+        array[__x].idx1 = __reg1.idx;
+        array[__x].idx2 = __reg2.idx;
         array[__x].dest = __dest;
         array[__x].src1 = __reg1.value();
         array[__x].src2 = __reg2.value();
     }
 
     /**
-     * @brief Update the dependency from RoB.
+     * @brief Wake up commands on a physical register written.
      * 
+     * @param __data Value with the physical tag as idx.
      * @attention Use it in the end of a cycle after inserting.
      */
     void update(wrapper __data) noexcept {
         for(auto i  = array_state._Find_first() ;
                  i != array_state.size() ; i = array_state._Find_next(i)) {
-            if(array[i].idx1 == __data.index()) {
-                array[i].idx1 = FREE;
+            if(array[i].idx1 == __data.idx) {
+                array[i].idx1 = PHYS_FREE;
                 array[i].src1 = __data.value();
             }
-            if(array[i].idx2 == __data.index()) {
-                array[i].idx2 = FREE;
+            if(array[i].idx2 == __data.idx) {
+                array[i].idx2 = PHYS_FREE;
                 array[i].src2 = __data.value();
             }
         }
@@ -27,6 +27,12 @@ struct round_queue {
 
     T &operator [](int x) noexcept { return data[x]; }
 
+    /* Pop an element from the back of the queue. */
+    void pop_back() noexcept { --dist; }
+
+    /* Return reference to the last element. */
+    T &back() noexcept { return data[tail() ? tail() - 1 : __n - 1]; }
+
     /* Return reference to the first element. */
     T &front() noexcept { return data[head]; }
     /* Return const reference to the first element. */
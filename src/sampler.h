@@ -0,0 +1,108 @@
+#ifndef _RISC_V_SAMPLER_H_
+#define _RISC_V_SAMPLER_H_
+
+#include "cpu.h"
+#include "functional.h"
+
+#include <cmath>
+
+namespace dark {
+
+/**
+ * @brief Statistical sampling simulation in the way of SMARTS.
+ * Each period starts with a short detailed window of the pipeline
+ * (warm-up, then measurement) and goes on with functional warming
+ * of the predictor. Total cycles are estimated from sampled CPI.
+ * 
+ */
+struct sampler {
+    size_t period = 100000; /* Commands in one sampling period.     */
+    size_t warmup = 2000;   /* Detailed commands before measuring. */
+    size_t window = 1000;   /* Detailed commands measured.          */
+
+    size_t instructions = 0;    /* Total commited commands. */
+    size_t detailed     = 0;    /* Commands run in detail.  */
+    size_t samples      = 0;    /* Count of CPI samples.    */
+    double sum  = 0;            /* Sum of sampled CPI.      */
+    double sum2 = 0;            /* Sum of squared CPI.      */
+
+    /* Add one CPI sample. */
+    void record(size_t __cycles,size_t __count) noexcept {
+        double __cpi = double(__cycles) / __count;
+        ++samples , sum += __cpi , sum2 += __cpi * __cpi;
+    }
+
+    /**
+     * @brief Run in detail for one window, then drain.
+     * 
+     * @return Whether the program may go on.
+     */
+    bool work_detailed(cpu &__c) noexcept {
+        size_t __beg  = __c.instructions();
+        bool   __live = true;
+        while(__live && __c.instructions() - __beg < warmup) __live = __c.work();
+
+        size_t __clk = __c.clock;
+        size_t __cnt = __c.instructions();
+        while(__live && __c.instructions() - __cnt < window) __live = __c.work();
+
+        /* A window cut by the end is only used if nothing else is. */
+        if(__c.instructions() != __cnt && (__live || samples == 0))
+            record(__c.clock - __clk,__c.instructions() - __cnt);
+
+        if(__live) {
+            __c.drain();
+            while(!__c.drained() && (__live = __c.work()));
+        }
+
+        detailed     += __c.instructions() - __beg;
+        instructions += __c.instructions() - __beg;
+        if(__live) __c.resume();
+        return __live;
+    }
+
+    /**
+     * @brief Run in functional mode for the rest of a period.
+     * 
+     * @return Whether the program may go on.
+     */
+    bool work_functional(cpu &__c) noexcept {
+        size_t __n = period > warmup + window ? period - warmup - window : 0;
+        while(__n--) {
+            if(!functional_unit::work(__c,__c,__c)) return false;
+            ++instructions;
+        } return true;
+    }
+
+    /* Run the program until the end. */
+    void run(cpu &__c) noexcept
+    { while(work_detailed(__c) && work_functional(__c)); }
+
+    /* Mean CPI of all samples. */
+    double cpi() const noexcept { return samples ? sum / samples : 0; }
+
+    /* Half width of the 95% confidence interval of mean CPI. */
+    double cpi_error() const noexcept {
+        if(samples < 2) return 0;
+        double __mean = cpi();
+        double __var  = (sum2 - samples * __mean * __mean) / (samples - 1);
+        return 1.96 * std::sqrt(__var > 0 ? __var / samples : 0);
+    }
+
+    /* Estimated total cycles. */
+    double cycles() const noexcept { return cpi() * instructions; }
+
+    /* Print the estimation. */
+    void print(std::ostream &__os) const {
+        __os << "Instructions: " << instructions
+             << " (" << detailed << " in detail)\n"
+             << "Samples: " << samples << '\n'
+             << "CPI: " << cpi() << " +- " << cpi_error() << " (95%)\n"
+             << "Estimated cycles: " << size_t(cycles())
+             << " +- " << size_t(cpi_error() * instructions) << '\n';
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef _RISC_V_SIMULATOR_H_
+#define _RISC_V_SIMULATOR_H_
+
+#include "cpu.h"
+
+#include <memory>
+
+namespace dark {
+
+/**
+ * @brief Embeddable interface of the simulator.
+ * Several simulators may live in one process; each one owns its cpu.
+ * Steps are batched, so a call simulates many cycles in a tight loop.
+ * 
+ */
+struct simulator {
+    std::unique_ptr <cpu> core = std::make_unique <cpu> ();
+
+    /* Load a program image in hex text format ("@addr" + bytes). */
+    void load(const char *__str,size_t __len) noexcept { core->init(__str,__len); }
+
+    /* Load raw bytes into memory at given address. */
+    void load(address_type __pos,const void *__buf,size_t __len) noexcept {
+        if(__pos >= memory_size) return;
+        if(__len > memory_size - __pos) __len = memory_size - __pos;
+        memcpy(core->data + __pos,__buf,__len);
+        core->mark(__pos,__len);
+    }
+
+    /* Start over with empty memory and a fresh pipeline. */
+    void reset() noexcept { core->reset(); }
+
+    /**
+     * @brief Run for at most __n cycles.
+     * 
+     * @return Count of cycles simulated.
+     */
+    size_t run_cycles(size_t __n) noexcept { return core->run(__n); }
+
+    /**
+     * @brief Run until at least __n more commands are commited.
+     * 
+     * @return Count of commands commited.
+     */
+    size_t run_instructions(size_t __n) noexcept {
+        size_t __beg = core->instructions();
+        size_t __end = __beg + __n;
+        while(core->instructions() < __end && core->work());
+        return core->instructions() - __beg;
+    }
+
+    /* Run until the program ends. Return total cycles. */
+    size_t run() noexcept { while(core->work()); return core->clock; }
+
+    /* Whether the program has ended. */
+    bool halted() const noexcept { return core->is_terminal(); }
+
+    /* Exit code: from exit device if used, or lowest byte of a0. */
+    word_utype exit_code() const noexcept {
+        return core->is_exit() ? core->device().exit_code
+                               : (uint8_t)core->arch(10);
+    }
+
+    /* Architectural register value. */
+    register_type reg(size_t __idx) const noexcept { return core->arch(__idx & 31); }
+
+    /* Read raw bytes from memory. Bytes out of range read as 0. */
+    void read(address_type __pos,void *__buf,size_t __len) const noexcept {
+        memset(__buf,0,__len);
+        if(__pos >= memory_size) return;
+        if(__len > memory_size - __pos) __len = memory_size - __pos;
+        memcpy(__buf,core->data + __pos,__len);
+    }
+
+    /* Read a word from memory. */
+    word_utype read_word(address_type __pos) const noexcept {
+        word_utype __v;
+        read(__pos,&__v,4);
+        return __v;
+    }
+
+    size_t clock()        const noexcept { return core->clock; }
+    size_t instructions() const noexcept { return core->instructions(); }
+    size_t branches()     const noexcept { return core->branches(); }
+    double accuracy()     const noexcept { return core->get_accuracy(); }
+};
+
+}
+
+#endif
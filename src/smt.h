@@ -0,0 +1,134 @@
+#ifndef _RISC_V_SMT_H_
+#define _RISC_V_SMT_H_
+
+#include "cpu.h"
+
+#include <memory>
+
+namespace dark {
+
+/**
+ * @brief Simultaneous multithreading: two guest programs on one core.
+ * Each thread keeps its own PC, rename map and physical registers,
+ * predictor history, locks and memory image, so a mispredict flushes
+ * only the thread at fault. Each thread is a whole cpu, so the RS, the
+ * ALUs and the load buffer are per thread too, not one shared pool. A
+ * shared RS would need thread tags on every entry and bus, and both
+ * are bounded by the shared RoB below. They share:
+ *
+ *  The front end : one thread fetches and issues in a cycle, picked
+ *                  round-robin or by ICOUNT (fewest commands in flight).
+ *  The RoB       : dynamic (any split of the 31 entries) or
+ *                  partitioned (half for each thread). The RS is larger
+ *                  than the RoB, so it is bounded by the RoB share.
+ *  Memory ports  : loads and stores of both threads count against the
+ *                  same ports. A store over the limit takes a port its
+ *                  thread holds, stopping the load on it.
+ *
+ */
+struct smt_core {
+    enum : byte_utype { ROUND_ROBIN, ICOUNT };
+    enum : byte_utype { DYNAMIC, PARTITIONED };
+
+    cpu *thread[2] = {nullptr,nullptr};
+    std::unique_ptr <cpu> owned;    /* Thread 1. */
+    bool   done[2] = {false,false}; /* Whether a thread ended. */
+    size_t turns[2] = {0,0};        /* Cycles a thread had the front end. */
+    size_t clock = 0;               /* Cycles of the core. */
+    byte_utype fetch_policy = ICOUNT;
+    byte_utype rob_policy   = DYNAMIC;
+
+    /**
+     * @brief Take __main as thread 0, and the program image in hex
+     * text format as thread 1, with the same options as __main.
+     */
+    void init(cpu &__main,const char *__str,size_t __len) {
+        owned = std::make_unique <cpu> ();
+        owned->init(__str,__len);
+        owned->hartid = 1;
+        owned->console.mute();  /* The output is the first thread's. */
+        owned->ports  = __main.ports;
+        owned->lvp_enable    = __main.lvp_enable;
+        owned->loop_enable   = __main.loop_enable;
+        owned->ss_enable     = __main.ss_enable;
+        owned->fusion_enable = __main.fusion_enable;
+        owned->elim_enable   = __main.elim_enable;
+        owned->fq_enable     = __main.fq_enable;
+        owned->fq_depth      = __main.fq_depth;
+        owned->dram_enable   = __main.dram_enable;
+        owned->dram.configure(__main.dram.channels,__main.dram.banks);
+        thread[0] = &__main;
+        thread[1] = owned.get();
+    }
+
+    /* Run until both threads end. */
+    void run() noexcept { while(work()); }
+
+    /**
+     * @brief Work for one cycle of the core.
+     *
+     * @return Whether a thread is still running.
+     */
+    bool work() noexcept {
+        if(done[0] && done[1]) return false;
+        ++clock;
+        int __turn = pick();
+        if(__turn >= 0) ++turns[__turn];
+
+        int __used = thread[0]->queue.size() + thread[1]->queue.size();
+        for(int i = 0 ; i != 2 ; ++i) {
+            auto &__c = *thread[i];
+            __c.smt_turn  = i == __turn;
+            __c.rob_limit = rob_policy == PARTITIONED ? FREE / 2
+                          : __c.queue.size() + FREE - __used;
+        }
+
+        /* Loads started by the first to work hold ports for the other. */
+        int __first = clock & 1;
+        for(int k = 0 ; k != 2 ; ++k) {
+            int i = __first ^ k;
+            if(done[i]) continue;
+            auto &__c = *thread[i];
+            auto &__o = *thread[i ^ 1];
+            __c.port_limit = __c.ports - (done[i ^ 1] ? 0 : __o.busy_ports());
+            done[i] = !__c.work();
+        } return !(done[0] && done[1]);
+    }
+
+    /* Thread to have the front end in this cycle. (-1 if none can use it) */
+    int pick() noexcept {
+        bool __can[2];
+        for(int i = 0 ; i != 2 ; ++i) {
+            auto &__c = *thread[i];
+            __can[i] = !done[i] && !__c.jalr_lock;
+        }
+        if(!__can[0] || !__can[1]) return __can[0] ? 0 : (__can[1] ? 1 : -1);
+
+        int __rr = clock & 1;   /* Round-robin choice, also the tie break. */
+        if(fetch_policy == ROUND_ROBIN) return __rr;
+        size_t __n0 = in_flight(*thread[0]);
+        size_t __n1 = in_flight(*thread[1]);
+        return __n0 == __n1 ? __rr : __n1 < __n0;
+    }
+
+    /* Commands of a thread fetched but not commited. */
+    static size_t in_flight(const cpu &__c) noexcept {
+        return __c.queue.size() + __c.fetch_pre + (__c.fq_enable ? __c.ib.size() : 0);
+    }
+
+    /* Print statistics of the core and each thread. */
+    void print(std::ostream &__os) const {
+        size_t __sum = thread[0]->instructions() + thread[1]->instructions();
+        __os << "SMT: " << clock << " cycles, IPC "
+             << double(__sum) / std::max <size_t> (clock,1) << '\n';
+        for(int i = 0 ; i != 2 ; ++i)
+            __os << "Thread " << i << ": clock " << thread[i]->clock
+                 << ", instructions " << thread[i]->instructions()
+                 << ", front end " << turns[i] << " cycles"
+                 << ", a0 " << thread[i]->arch(10) << '\n';
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef _RISC_V_STAGE_TIMER_H_
+#define _RISC_V_STAGE_TIMER_H_
+
+#include "utility.h"
+
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <ctime>
+#endif
+
+namespace dark {
+
+/**
+ * @brief Host time of the simulator itself, by pipeline stage.
+ * Only one simulated cycle in a period is timed, to keep the cost
+ * low; a stage timed counts its ticks (rdtsc, or nanoseconds where
+ * there is no TSC) and calls in such cycles. The cycles timed run
+ * an instance of the cycle with the timers, the others one without.
+ *
+ * Compiled in only with RISCV_STAGE_TIMING=N (N the period), as in
+ * `cmake -DRISCV_STAGE_TIMING=64`. Otherwise RISCV_STAGE is empty.
+ *
+ */
+struct stage_timer {
+    enum stage : int {
+        FETCH, MEMORY, ROB, RS, ACCOUNT,
+        SYNC_ISSUE, SYNC_BUS, SYNC_INSTRUCTION,
+        SYNC_MEMORY, SYNC_ROB, SYNC_RS, ATOMIC,
+        CYCLE, /* The whole cycle. */
+        COUNT
+    };
+
+    static constexpr const char *names[COUNT] = {
+        "work_fetch", "memory::work", "reorder_buffer::work",
+        "reservation_station::work", "account",
+        "sync_issue", "sync_bus", "sync_instruction",
+        "memory::sync", "reorder_buffer::sync",
+        "reservation_station::sync", "work_atomic",
+        "cycle"
+    };
+
+    size_t ticks[COUNT] = {};   /* Ticks in cycles timed. */
+    size_t calls[COUNT] = {};   /* Calls in cycles timed. */
+#ifdef RISCV_STAGE_TIMING
+    static constexpr size_t kPERIOD = RISCV_STAGE_TIMING;
+#else
+    static constexpr size_t kPERIOD = 64;
+#endif
+
+    size_t period  = kPERIOD;   /* Time one cycle out of this many. */
+    size_t counter = 0;         /* Cycles since the last timed one. */
+
+    static uint64_t now() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        timespec __t;
+        clock_gettime(CLOCK_MONOTONIC,&__t);
+        return __t.tv_sec * 1000000000ull + __t.tv_nsec;
+#endif
+    }
+
+    /* Start a cycle: return whether it is timed. */
+    bool next_cycle() noexcept {
+        if(++counter != period) return false;
+        return counter = 0 , true;
+    }
+
+    /* Time the scope it lives in. (Empty if not __timed) */
+    template <bool __timed>
+    struct scope {
+        scope(stage_timer &,stage) noexcept {}
+    };
+
+    /* Least ticks between two reads of the timer. */
+    static size_t cost() noexcept {
+        uint64_t __min = ~uint64_t(0);
+        for(int i = 0 ; i != 1000 ; ++i) {
+            uint64_t __x = now();
+            __min = std::min(__min,now() - __x);
+        } return __min;
+    }
+
+    /**
+     * @brief Print the share of each stage in the cycles timed.
+     * One timer read is taken off each call; the timer reads left
+     * (about two a call) are shown apart from the glue between stages.
+     */
+    void print(std::ostream &__os) const {
+        size_t __cost = cost();
+        size_t __net[COUNT],__sum = 0,__reads = 0;
+        for(int i = 0 ; i != COUNT ; ++i)
+            __net[i] = ticks[i] - std::min(ticks[i],calls[i] * __cost);
+        for(int i = 0 ; i != CYCLE ; ++i)
+            __sum += __net[i] , __reads += 2 * calls[i] * __cost;
+        __reads = std::min(__reads,__net[CYCLE] - std::min(__sum,__net[CYCLE]));
+        size_t __glue = __net[CYCLE] - std::min(__sum + __reads,__net[CYCLE]);
+
+        double __all = __net[CYCLE] ? __net[CYCLE] : 1;
+        auto __row = [&](const char *__name,size_t __calls,size_t __ticks) {
+            __os << "  " << std::setw(30) << std::left << __name
+                 << std::right << std::setw(10) << __calls
+                 << std::setw(14) << std::fixed << std::setprecision(1)
+                 << double(__ticks) / std::max <size_t> (__calls,1)
+                 << std::setw(7) << 100.0 * __ticks / __all << "%\n";
+        };
+        __os << "Stage timing: " << calls[CYCLE] << " cycles timed, 1 in "
+             << period << ", " << __cost << " ticks a timer read\n"
+             << "  stage                             calls    ticks/call   share\n";
+        for(int i = 0 ; i != CYCLE ; ++i) __row(names[i],calls[i],__net[i]);
+        __row("(glue between stages)",calls[CYCLE],__glue);
+        __row("(timer reads)",calls[CYCLE],__reads);
+        __row(names[CYCLE],calls[CYCLE],__net[CYCLE]);
+        __os << std::defaultfloat;
+    }
+};
+
+template <>
+struct stage_timer::scope <true> {
+    stage_timer &timer;
+    stage        which;
+    uint64_t     start;
+    scope(stage_timer &__t,stage __s) noexcept
+        : timer(__t) , which(__s) , start(now()) {}
+    ~scope() noexcept {
+        timer.ticks[which] += now() - start;
+        timer.calls[which] += 1;
+    }
+};
+
+}
+
+/* Time the rest of the scope as stage __name, in a cycle __timed. */
+#ifdef RISCV_STAGE_TIMING
+#define RISCV_STAGE(__name) dark::stage_timer::scope <__timed> \
+    __stage_scope(timing,dark::stage_timer::__name)
+#else
+#define RISCV_STAGE(__name)
+#endif
+
+#endif
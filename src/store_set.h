@@ -0,0 +1,92 @@
+#ifndef _RISC_V_STORE_SET_H_
+#define _RISC_V_STORE_SET_H_
+
+#include "utility.h"
+
+#include <algorithm>
+
+namespace dark {
+
+/**
+ * @brief Store-set memory dependence predictor (Chrysos & Emer).
+ * A load waits only for the last store fetched in its store set,
+ * and goes ahead of all the other stores not commited. When a store
+ * commits over a younger load which has read memory already, the
+ * pipeline is flushed after the store and the two are put in one set.
+ *
+ */
+struct store_set {
+    static constexpr uint32_t   kSIZE = 1024;   /* Entries of the SSIT. */
+    static constexpr uint32_t   kSETS = 128;    /* Store sets. */
+    static constexpr byte_utype kNONE = 0xff;   /* No store set. */
+
+    byte_utype   ssit[kSIZE];   /* Store set of a load/store PC. */
+    byte_utype   lfst[kSETS];   /* Last store fetched in a set (RoB index). */
+    address_type ss_pc[32];     /* PC of a load/store by RoB index. */
+    byte_utype   ss_set[32];    /* Store set of a store by RoB index. */
+    byte_utype   ss_next = 0;   /* Next store set to give out. */
+    bool         ss_enable = false;     /* Whether loads may go ahead. */
+    size_t       ss_count[2] = {0,0};   /* Loads ahead / violations. */
+
+    store_set() noexcept {
+        memset(ssit,kNONE,sizeof(ssit));
+        memset(ss_set,kNONE,sizeof(ss_set));
+        memset(lfst,FREE,sizeof(lfst));
+    }
+
+    static uint32_t ss_locate(address_type __pc) noexcept { return (__pc >> 2) % kSIZE; }
+
+    /**
+     * @brief A load is issued into RoB position __pos.
+     * Only used when ss_enable is set.
+     *
+     * @param __last The last store not commited.
+     * @return The store to wait for. (FREE if none)
+     */
+    byte_utype ss_load(address_type __pc,uint32_t __pos,byte_utype __last) noexcept {
+        ss_pc[__pos] = __pc;
+        if(__last == FREE) return FREE;
+        byte_utype __set  = ssit[ss_locate(__pc)];
+        byte_utype __prev = __set == kNONE ? FREE : lfst[__set];
+        if(__prev != __last) ++ss_count[0];
+        return __prev;
+    }
+
+    /* A store (or atomic) is issued into RoB position __pos. */
+    void ss_store(address_type __pc,uint32_t __pos) noexcept {
+        ss_pc[__pos]  = __pc;
+        ss_set[__pos] = ssit[ss_locate(__pc)];
+        if(ss_set[__pos] != kNONE) lfst[ss_set[__pos]] = __pos;
+    }
+
+    /* The store in RoB position __pos is commited or squashed. */
+    void ss_cancel(uint32_t __pos) noexcept {
+        byte_utype __set = ss_set[__pos];
+        if(__set == kNONE) return;
+        if(lfst[__set] == __pos) lfst[__set] = FREE;
+        ss_set[__pos] = kNONE;
+    }
+
+    /* The load in RoB position __load has read before the store in __store. */
+    void ss_violate(uint32_t __load,uint32_t __store) noexcept {
+        ++ss_count[1];
+        auto &__l = ssit[ss_locate(ss_pc[__load])];
+        auto &__s = ssit[ss_locate(ss_pc[__store])];
+        if(__l == kNONE && __s == kNONE) {
+            __l = __s = ss_next;
+            ss_next = (ss_next + 1) % kSETS;
+        } else if(__l == kNONE) __l = __s;
+        else if(__s == kNONE)   __s = __l;
+        else __l = __s = std::min(__l,__s); /* Merge into the smaller. */
+    }
+
+    /* Clear the pipeline: no store in flight. */
+    void clear_pipeline() noexcept {
+        memset(ss_set,kNONE,sizeof(ss_set));
+        memset(lfst,FREE,sizeof(lfst));
+    }
+};
+
+}
+
+#endif
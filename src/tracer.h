@@ -0,0 +1,152 @@
+#ifndef _RISC_V_TRACER_H_
+#define _RISC_V_TRACER_H_
+
+#include "utility.h"
+#include "instruction.h"
+
+#include <stdio.h>
+
+namespace dark {
+
+/**
+ * @brief Per-instruction pipeline timeline in gem5 O3PipeView format,
+ * which Konata and util/o3-pipeview.py load directly.
+ * A command is recorded from issue on, by its RoB index, and written
+ * out when commited or squashed. Only commands fetched inside the
+ * cycle window and PC window are written.
+ *
+ * Stages: fetch = fetched, decode/rename/dispatch = issued into
+ * RoB/RS/LSB, issue = started executing, complete = written back
+ * on the bus, retire = commited (0 if squashed).
+ *
+ */
+struct pipeline_tracer {
+    static constexpr size_t kTICK = 1000; /* Ticks of a cycle, as gem5. */
+
+    struct record {
+        address_type pc;        /* PC of the command. */
+        command_type command;   /* The command.       */
+        size_t seq;             /* Sequence number.   */
+        size_t fetch;           /* Cycle fetched.     */
+        size_t issue;           /* Cycle issued.      */
+        size_t execute;         /* Cycle started executing.  */
+        size_t complete;        /* Cycle written back.       */
+        bool   live;            /* Whether still in the RoB. */
+    };
+
+    record slot[32] = {};   /* Indexed by RoB position. */
+    FILE  *out = nullptr;   /* Output file. */
+    size_t seq = 0;         /* Commands issued. */
+
+    size_t fetched_cur = 0; /* Fetch cycle of the command fetched. */
+    size_t fetched_pre = 0; /* Fetch cycle of the command to issue. */
+
+    size_t       cycle_lo = 0 , cycle_hi = ~size_t(0);  /* Cycle window. */
+    address_type    pc_lo = 0 ,    pc_hi = ~address_type(0); /* PC window. */
+
+    /* Open the output file. Return false if failed. */
+    bool open(const char *__path) noexcept { return (out = fopen(__path,"w")); }
+
+    /* Close the output file. */
+    void close() noexcept { if(out) fclose(out) , out = nullptr; }
+
+    ~pipeline_tracer() { close(); }
+
+    /* A command is fetched in cycle __clock. */
+    void fetch(size_t __clock) noexcept { fetched_cur = __clock; }
+
+    /* The command fetched moves on to issue. */
+    void advance() noexcept { fetched_pre = fetched_cur; }
+
+    /* The command fetched last is issued into RoB position __pos. */
+    void issue(int __pos,address_type __pc,command_type __cmd,
+               size_t __clock,bool __done) noexcept {
+        auto &__r = slot[__pos];
+        __r = {__pc,__cmd,seq++,fetched_pre,__clock,0,0,true};
+        if(__done) __r.execute = __r.complete = __clock;
+    }
+
+    /* The command in RoB position __pos starts executing. */
+    void execute(int __pos,size_t __clock) noexcept
+    { if(!slot[__pos].execute) slot[__pos].execute = __clock; }
+
+    /* The command in RoB position __pos writes back its result. */
+    void complete(int __pos,size_t __clock) noexcept
+    { execute(__pos,__clock); slot[__pos].complete = __clock; }
+
+    /* The command in RoB position __pos is commited. */
+    void retire(int __pos,size_t __clock,bool __store) noexcept {
+        auto &__r = slot[__pos];
+        if(!__r.live) return;
+        __r.live = false;
+        emit(__r,__clock,__store ? __clock : 0);
+    }
+
+    /* The command in RoB position __pos is squashed. */
+    void squash(int __pos) noexcept {
+        auto &__r = slot[__pos];
+        if(!__r.live) return;
+        __r.live = false;
+        emit(__r,0,0);
+    }
+
+    /* All the commands in flight are squashed. */
+    void flush() noexcept { for(int i = 0 ; i != 32 ; ++i) squash(i); }
+
+    /* Write one record out, if inside the windows. */
+    void emit(const record &__r,size_t __retire,size_t __store) noexcept {
+        if(!out || __r.fetch < cycle_lo || __r.fetch >= cycle_hi) return;
+        if(__r.pc < pc_lo || __r.pc >= pc_hi) return;
+        char __name[48];
+        describe(__r.command,__name);
+        fprintf(out,"O3PipeView:fetch:%zu:0x%08x:0:%zu:%s\n",
+                __r.fetch * kTICK,__r.pc,__r.seq,__name);
+        fprintf(out,"O3PipeView:decode:%zu\n",  __r.issue * kTICK);
+        fprintf(out,"O3PipeView:rename:%zu\n",  __r.issue * kTICK);
+        fprintf(out,"O3PipeView:dispatch:%zu\n",__r.issue * kTICK);
+        fprintf(out,"O3PipeView:issue:%zu\n",   __r.execute * kTICK);
+        fprintf(out,"O3PipeView:complete:%zu\n",__r.complete * kTICK);
+        fprintf(out,"O3PipeView:retire:%zu:store:%zu\n",
+                __retire * kTICK,__store * kTICK);
+    }
+
+    /* Write a short disassembly of a command into __buf. */
+    static void describe(command_type __cmd,char *__buf) noexcept {
+        static const char *const kBRANCH[8] = {"beq","bne","b?","b?","blt","bge","bltu","bgeu"};
+        static const char *const kLOAD[8]   = {"lb","lh","lw","l?","lbu","lhu","l?","l?"};
+        static const char *const kSTORE[8]  = {"sb","sh","sw","s?","s?","s?","s?","s?"};
+        static const char *const kALU[8]    = {"add","sll","slt","sltu","xor","srl","or","and"};
+        instruction __i = {__cmd};
+        const char *__op = kALU[__i.mid];
+        switch(__i.suc) {
+            case suc_code::lui   : sprintf(__buf,"lui x%u,0x%x",__i.rd,__i.U_imm_31_12); return;
+            case suc_code::auipc : sprintf(__buf,"auipc x%u,0x%x",__i.rd,__i.U_imm_31_12); return;
+            case suc_code::jal   : sprintf(__buf,"jal x%u,%d",__i.rd,(int)__i.J_immediate()); return;
+            case suc_code::jalr  :
+                sprintf(__buf,"jalr x%u,%d(x%u)",__i.rd,(int)__i.I_immediate(),__i.rs1); return;
+            case suc_code::bcode :
+                sprintf(__buf,"%s x%u,x%u,%d",kBRANCH[__i.mid],__i.rs1,__i.rs2,(int)__i.B_immediate()); return;
+            case suc_code::lcode :
+                sprintf(__buf,"%s x%u,%d(x%u)",kLOAD[__i.mid],__i.rd,(int)__i.I_immediate(),__i.rs1); return;
+            case suc_code::scode :
+                sprintf(__buf,"%s x%u,%d(x%u)",kSTORE[__i.mid],__i.rs2,(int)__i.S_immediate(),__i.rs1); return;
+            case suc_code::icode :
+                if(__i.mid == 0b101 && __i.pre) __op = "sra";
+                sprintf(__buf,"%si x%u,x%u,%d",__op,__i.rd,__i.rs1,
+                        __i.mid == 0b001 || __i.mid == 0b101 ? int(__i.rs2) : (int)__i.I_immediate());
+                return;
+            case suc_code::rcode :
+                if(__i.mid == 0b101 && __i.pre) __op = "sra";
+                if(__i.mid == 0b000 && __i.pre) __op = "sub";
+                sprintf(__buf,"%s x%u,x%u,x%u",__op,__i.rd,__i.rs1,__i.rs2); return;
+            case suc_code::acode : sprintf(__buf,"amo x%u,x%u,(x%u)",__i.rd,__i.rs2,__i.rs1); return;
+            case suc_code::fence : sprintf(__buf,"fence"); return;
+            case suc_code::scall : sprintf(__buf,"csr x%u,0x%x",__i.rd,__i.I_imm_11_00); return;
+            default: sprintf(__buf,"0x%08x",__cmd);
+        }
+    }
+};
+
+}
+
+#endif
@@ -24,9 +24,32 @@ enum class suc_code : uint8_t {
     lcode = 0b0000011, // Load
     scode = 0b0100011, // Store
     icode = 0b0010011, // Immediate
-    rcode = 0b0110011  // Arithmetic
+    rcode = 0b0110011, // Arithmetic
+    acode = 0b0101111, // Atomic
+    fence = 0b0001111, // Fence
+    scall = 0b1110011  // System (CSR)
 };
 
+/* Pre : bit 31 ~ 27 of atomic command. */
+enum class AMO_code : uint8_t {
+    ADD  = 0b00000,
+    SWAP = 0b00001,
+    LR   = 0b00010,
+    SC   = 0b00011,
+    XOR  = 0b00100,
+    OR   = 0b01000,
+    AND  = 0b01100,
+    MIN  = 0b10000,
+    MAX  = 0b10100,
+    MINU = 0b11000,
+    MAXU = 0b11100,
+};
+
+constexpr uint32_t CSR_MHARTID = 0xf14; /* Hart ID register. */
+
+/* Revision of the default timing. Bump it with any change of clocks. */
+constexpr uint32_t TIMING_REVISION = 2; /* 2: physical register file. */
+
 /* Mid : bit 14 ~ 12*/
 enum class mid_code : int8_t {
     B_type, /* ALU code. */
@@ -53,6 +76,10 @@ enum class ALU_code : int8_t {
     LTU =  0b011,
     GEU = ~0b011,
 
+    SH1ADD = 0b1001, /* Fused shift-add: (reg1 << 1) + reg2. */
+    SH2ADD = 0b1010,
+    SH3ADD = 0b1011,
+
     WORKING = ~0b100  /* Magic number. */
 };
 
@@ -78,10 +105,12 @@ enum class MEM_code : uint8_t {
 };
 
 constexpr uint32_t       FREE = 31; /* Maximum available in RoB. */
+constexpr uint32_t  PHYS_FREE = 63; /* Tag of a ready physical register. */
 constexpr uint32_t    REG_TAG = 0;  /* Noraml command. */ 
 constexpr uint32_t   JALR_TAG = 1;  /* JALR.   */
-constexpr uint32_t  STORE_TAG = 2;  /* JALR.   */
+constexpr uint32_t  STORE_TAG = 2;  /* Store.  */
 constexpr uint32_t BRANCH_TAG = 3;  /* B-type. */
+constexpr uint32_t ATOMIC_TAG = 4;  /* Atomic. */
 
 /* Simple wrapper of bus value. */
 struct wrapper { /* 32 + 7 bits */
@@ -139,22 +168,33 @@ using register_type = uint32_t;
 using return_list = std::vector <wrapper>;
 
 /* Judge whether given char is a visible char */
-bool is_visible_char(int __c) noexcept
+inline bool is_visible_char(int __c) noexcept
 { return __c < 127 && __c > 32; }
 
-/* Read a token. Return whether EOF isn't reached. */
-bool read_token(char *__str) noexcept {
+/**
+ * @brief Read a token from a source of chars.
+ * 
+ * @param __get Return next char, or EOF at the end.
+ * @return Whether EOF isn't reached.
+ */
+template <class F>
+bool read_token(char *__str,F &&__get) noexcept {
     int __c;
-    while(!is_visible_char(__c = getchar()))
+    while(!is_visible_char(__c = __get()))
         if(__c == EOF) return false;
     while(is_visible_char(__c)) {
         *(__str++) = __c;
-        __c  = getchar();
+        __c  = __get();
     }*__str = 0; return true;
 }
 
+/* Read a token from stdin. Return whether EOF isn't reached. */
+inline bool read_token(char *__str) noexcept
+{ return read_token(__str,[]() { return getchar(); }); }
+
 /* Map a char into a hex number. */
-int char_map(char x) noexcept { return isdigit(x) ? x - '0' : x - 'A' + 10; }
+inline int char_map(char x) noexcept
+{ return isdigit(x) ? x - '0' : (x | 0x20) - 'a' + 10; }
 
 /* Turn a hex number string into a trivial number type. */
 template <class T>
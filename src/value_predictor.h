@@ -0,0 +1,115 @@
+#ifndef _RISC_V_VALUE_PREDICTOR_H_
+#define _RISC_V_VALUE_PREDICTOR_H_
+
+#include "utility.h"
+
+namespace dark {
+
+/**
+ * @brief Last-value / stride load value predictor keyed by load PC.
+ * A confident load gets its value guessed at issue, so that its
+ * consumers need not wait. The guess is verified when the load
+ * commits, and a wrong guess flushes the pipeline.
+ *
+ */
+struct value_predictor {
+    static constexpr uint32_t kSIZE = 1024; /* Entries in the table. */
+    static constexpr uint8_t  kCONF = 10;   /* Confidence to guess.  */
+    static constexpr uint8_t  kMAXC = 15;   /* Maximum confidence.   */
+
+    struct entry {
+        address_type   pc;          /* PC of the load. */
+        register_type  last;        /* Last value commited. */
+        register_type  stride;      /* Difference of last two values. */
+        byte_utype     conf;        /* Confidence of the stride. */
+        byte_utype     inflight;    /* Loads issued, not commited. */
+    };
+
+    /* Load information of a RoB entry. */
+    struct slot {
+        address_type   pc;      /* PC of the load. */
+        register_type  value;   /* Value guessed.  */
+        bool           load;    /* Whether a load. */
+        bool           guess;   /* Whether value guessed. */
+    };
+
+    entry  table[kSIZE] = {};       /* Prediction table.        */
+    slot   slots[FREE + 1] = {};    /* Indexed by RoB position. */
+    bool   lvp_enable = false;  /* Whether to guess values. */
+    size_t lvp_count[3] = {0,0,0}; /* Loads / guessed / correct. */
+
+    static uint32_t locate(address_type __pc) noexcept { return (__pc >> 2) % kSIZE; }
+
+    /**
+     * @brief Record a load issued into RoB position __pos.
+     * Only used when lvp_enable is set.
+     *
+     * @return Whether __val holds a confident guess.
+     */
+    bool guess(address_type __pc,uint32_t __pos,register_type &__val) noexcept {
+        auto &__e = table[locate(__pc)];
+        auto &__s = slots[__pos];
+        __s = {__pc,0,true,false};
+        if(__e.pc == __pc && __e.conf >= kCONF) {
+            __s.guess = true;
+            __s.value = __val = __e.last + __e.stride * (__e.inflight + 1);
+        } ++__e.inflight;
+        return __s.guess;
+    }
+
+    /**
+     * @brief Train with a load commited from RoB position __pos.
+     *
+     * @return Whether the guess of this load was wrong.
+     */
+    bool verify(uint32_t __pos,register_type __val) noexcept {
+        auto &__s = slots[__pos];
+        if(!__s.load) return false;
+        __s.load = false;
+
+        auto &__e = table[locate(__s.pc)];
+        if(__e.inflight) --__e.inflight;
+        if(__e.pc != __s.pc) {
+            __e.pc     = __s.pc;
+            __e.stride = 0;
+            __e.conf   = 0;
+        } else if(__val - __e.last == __e.stride) {
+            if(__e.conf != kMAXC) ++__e.conf;
+        } else {
+            __e.stride = __val - __e.last;
+            __e.conf   = 0;
+        } __e.last = __val;
+
+        ++lvp_count[0];
+        if(!__s.guess) return false;
+        ++lvp_count[1];
+        if(__s.value == __val) return ++lvp_count[2] , false;
+        __e.conf = 0;
+        return true;
+    }
+
+    /* Forget the load in RoB position __pos, if any. */
+    void cancel(uint32_t __pos) noexcept {
+        auto &__s = slots[__pos];
+        if(!__s.load) return;
+        auto &__e = table[locate(__s.pc)];
+        if(__e.inflight) --__e.inflight;
+        __s.load = false;
+    }
+
+    /* Clear the pipeline: forget all loads in flight. */
+    void clear_pipeline() noexcept
+    { for(uint32_t i = 0 ; i != FREE + 1 ; ++i) cancel(i); }
+
+    /* Ratio of commited loads with guessed value. */
+    double lvp_coverage() const noexcept
+    { return lvp_count[0] ? double(lvp_count[1]) / lvp_count[0] : 0; }
+
+    /* Ratio of guessed values which are correct. */
+    double lvp_accuracy() const noexcept
+    { return lvp_count[1] ? double(lvp_count[2]) / lvp_count[1] : 0; }
+};
+
+}
+
+#endif
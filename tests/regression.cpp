@@ -0,0 +1,99 @@
+/* Regression checks of the simulator. Returns the count of failures. */
+#include "../src/pool.h"
+#include "../src/sampler.h"
+
+#include <string>
+
+namespace dark {
+
+int failed = 0;
+
+/* Report a check that fails. */
+void expect(bool __ok,const char *__what) {
+    if(__ok) return;
+    std::cerr << "FAILED: " << __what << '\n';
+    ++failed;
+}
+
+/* Sum of 1..40 plus 3 for each odd, through memory: exits with 112. */
+const std::string kSUM =
+    "@00000000\n"
+    "B7 24 00 00 93 84 04 00 13 04 80 02 13 05 00 00 93 12 24 00 B3 82 92 00 23 A0 82 00 13 04 F4 FF E3 18 04 FE 13 04 80 02 93 12 24 00 B3 82 92 00 03 A3 02 00 93 03 03 00 33 05 75 00 13 7E 13 00 63 04 0E 00 13 05 35 00 13 04 F4 FF E3 1E 04 FC 13 75 F5 0F 13 05 F0 0F\n";
+constexpr word_utype kSUM_EXIT = 112;
+
+/* kSUM with a data word at 0x1020 that reads as a forward branch, in
+   the predictor entry of the backward branch at 0x20. */
+const std::string kSUM_DATA = kSUM + "@00001020\n63 04 00 00\n";
+
+/* fib(100) mod 256 by moves, whose registers are then written: 195. */
+const std::string kFIB =
+    "@00000000\n"
+    "13 04 40 06 13 05 00 00 93 05 10 00 B3 02 B5 00 13 85 05 00 93 85 02 00 13 04 F4 FF E3 18 04 FE 13 75 F5 0F 13 05 F0 0F\n";
+constexpr word_utype kFIB_EXIT = 195;
+
+/* Run a cpu to the end. */
+void run(cpu &__c) { while(__c.work()); }
+
+/* A cpu given back to the pool comes out as a new one. */
+void test_pool_reset() {
+    auto __fresh = std::make_unique <cpu> ();
+    __fresh->init(kSUM.data(),kSUM.size());
+    run(*__fresh);
+
+    cpu_pool __pool;
+    cpi_stack __stack;
+    auto __c = __pool.acquire();
+    __c->init(kSUM.data(),kSUM.size());
+    __c->ports = memory::kPORTS;
+    __c->lvp_enable = __c->loop_enable = __c->ss_enable = true;
+    __c->fusion_enable = __c->elim_enable = __c->fq_enable = true;
+    __c->dram_enable = true;
+    __c->stack = &__stack;
+    run(*__c);
+    __pool.release(std::move(__c));
+
+    __c = __pool.acquire();
+    expect(__c->ports == 1,"pool: ports reset");
+    expect(__c->port_limit == memory::kPORTS,"pool: port_limit reset");
+    expect(!__c->stack && !__c->trace && !__c->profile,"pool: observers detached");
+    expect(!__c->lvp_enable && !__c->loop_enable && !__c->ss_enable &&
+           !__c->fusion_enable && !__c->elim_enable && !__c->fq_enable &&
+           !__c->dram_enable,"pool: options reset");
+    __c->init(kSUM.data(),kSUM.size());
+    run(*__c);
+    expect(__c->clock == __fresh->clock,"pool: same clock as a new cpu");
+    expect(uint8_t(__c->arch(10)) == kSUM_EXIT,"pool: exit code");
+}
+
+/* Static hints read the text only, and backward hints win. */
+void test_static_hint() {
+    auto __c = std::make_unique <cpu> ();
+    __c->init(kSUM_DATA.data(),kSUM_DATA.size());
+    __c->hint_branches();
+    expect(__c->mapping[0x20].data == ~0u,"hint: backward branch kept");
+    run(*__c);
+    expect(uint8_t(__c->arch(10)) == kSUM_EXIT,"hint: exit code");
+}
+
+/* Functional mode after moves eliminated keeps registers apart. */
+void test_sample_eliminate() {
+    for(size_t __period : {7u,13u,29u,50u}) {
+        auto __c = std::make_unique <cpu> ();
+        __c->init(kFIB.data(),kFIB.size());
+        __c->elim_enable = true;
+        sampler __s;
+        __s.period = __period , __s.warmup = 3 , __s.window = 2;
+        __s.run(*__c);
+        expect(uint8_t(__c->arch(10)) == kFIB_EXIT,"sample+eliminate: exit code");
+    }
+}
+
+}
+
+signed main() {
+    dark::test_pool_reset();
+    dark::test_static_hint();
+    dark::test_sample_eliminate();
+    if(!dark::failed) std::cerr << "All passed\n";
+    return dark::failed;
+}